@@ -9,6 +9,10 @@
 #include <filesystem>
 #include <cstring>
 #include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // 🎬 VIDEO DECODING - FFMPEG LIBRARIES
 extern "C" {
@@ -76,6 +80,105 @@ struct FrameIndexEntry {
 };
 #pragma pack(pop)
 
+// 🧱 FRAME ARENA - every frame back to back in one mmapped block at a 64-byte aligned stride.
+// Decoders memcpy straight into the next slot and the writer reads straight out, no per-frame
+// vectors!! Grows by doubling with mremap so nothing gets copied when it moves.
+class FrameArena {
+public:
+    FrameArena() = default;
+    ~FrameArena() { if (block) munmap(block, capacity_bytes); }
+    
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    
+    // Sets the frame size and reserves room for the expected frame count up front
+    void reset(int w, int h, size_t expected_frames) {
+        frame_size = (size_t)w * h * sizeof(RGBA);
+        stride = (frame_size + 63) & ~(size_t)63;
+        count = 0;
+        reserve(std::max<size_t>(expected_frames, 1));
+    }
+    
+    // Hands out the next frame slot to decode into
+    RGBA* append() {
+        if ((count + 1) * stride > capacity_bytes) reserve(std::max<size_t>(count * 2, 1));
+        return frame(count++);
+    }
+    
+    RGBA* frame(size_t i) { return (RGBA*)(block + i * stride); }
+    const RGBA* frame(size_t i) const { return (const RGBA*)(block + i * stride); }
+    size_t size() const { return count; }
+    size_t frame_bytes() const { return frame_size; }
+    
+private:
+    void reserve(size_t frames) {
+        size_t new_bytes = std::max<size_t>(frames * stride, 1);
+        if (new_bytes <= capacity_bytes) return;
+        
+        void* grown = block
+            ? mremap(block, capacity_bytes, new_bytes, MREMAP_MAYMOVE)
+            : mmap(nullptr, new_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (grown == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        // Transparent huge pages - big clips touch gigabytes, 4K TLB entries won't cut it
+        madvise(grown, new_bytes, MADV_HUGEPAGE);
+#endif
+        block = (uint8_t*)grown;
+        capacity_bytes = new_bytes;
+    }
+    
+    uint8_t* block = nullptr;
+    size_t capacity_bytes = 0;
+    size_t frame_size = 0;
+    size_t stride = 0;
+    size_t count = 0;
+};
+
+// 🗺️ MAPPED INPUT FILE - read-only mmap so decoders parse straight out of the page cache
+class MappedFile {
+public:
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return false;
+        
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        bytes = (const uint8_t*)mapped;
+        length = st.st_size;
+        return true;
+    }
+    
+    ~MappedFile() { if (bytes) munmap((void*)bytes, length); }
+    
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+    
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+};
+
+// 📋 ROW COPY - decoder output straight into an arena slot, one memcpy when rows are tight
+void copy_frame_rows(RGBA* dst, const uint8_t* src, int src_stride, int w, int h) {
+    size_t row_bytes = (size_t)w * sizeof(RGBA);
+    if ((size_t)src_stride == row_bytes) {
+        memcpy(dst, src, row_bytes * h);
+        return;
+    }
+    for (int y = 0; y < h; y++) {
+        memcpy(dst + (size_t)y * w, src + (size_t)y * src_stride, row_bytes);
+    }
+}
+
 // 🔥 FILE EXTENSION DETECTOR
 std::string get_file_extension(const std::string& path) {
     size_t dot_pos = path.find_last_of('.');
@@ -87,7 +190,7 @@ std::string get_file_extension(const std::string& path) {
 
 // 🎬 VIDEO FRAME EXTRACTOR USING FFMPEG
 bool extract_video_frames(const std::string& path, VideoInfo& info, 
-                         std::vector<std::vector<RGBA>>& frames_data,
+                         FrameArena& frames_data,
                          AudioData* audio_out = nullptr) {
     
     std::cout << "🎬 FFMPEG VIDEO DECODER ACTIVATED!! 🔥\n";
@@ -156,69 +259,21 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
     std::cout << "📊 Estimated frames: " << info.total_frames << "\n";
     std::cout << "🎵 Audio stream: " << (info.has_audio ? "YES 💚" : "NO") << "\n";
     
-    // Setup frame conversion to RGBA
-    SwsContext* sws_ctx = sws_getContext(
-        info.width, info.height, video_codec_ctx->pix_fmt,
-        info.width, info.height, AV_PIX_FMT_RGBA,
-        SWS_BILINEAR, nullptr, nullptr, nullptr
-    );
+    // 🎵 OPEN AUDIO DECODER UP FRONT - audio packets are decoded in the same read loop
+    // as video, so the file is demuxed exactly once (works for non-seekable inputs too!!)
+    AVCodecContext* audio_codec_ctx = nullptr;
+    SwrContext* swr_ctx = nullptr;
+    AVFrame* audio_frame = nullptr;
+    std::vector<float> interleaved_samples;
     
-    AVFrame* frame = av_frame_alloc();
-    AVFrame* frame_rgba = av_frame_alloc();
-    frame_rgba->format = AV_PIX_FMT_RGBA;
-    frame_rgba->width = info.width;
-    frame_rgba->height = info.height;
-    av_frame_get_buffer(frame_rgba, 0);
-    
-    AVPacket* packet = av_packet_alloc();
-    
-    std::cout << "🎬 Extracting frames with RGBA...\n";
+    if (audio_out) audio_out->total_samples = 0;
     
-    int frame_count = 0;
-    while (av_read_frame(fmt_ctx, packet) >= 0) {
-        if (packet->stream_index == video_stream_idx) {
-            if (avcodec_send_packet(video_codec_ctx, packet) >= 0) {
-                while (avcodec_receive_frame(video_codec_ctx, frame) >= 0) {
-                    // Convert to RGBA
-                    sws_scale(sws_ctx, frame->data, frame->linesize, 0, info.height,
-                            frame_rgba->data, frame_rgba->linesize);
-                    
-                    // Extract RGBA pixels
-                    std::vector<RGBA> pixels(info.width * info.height);
-                    uint8_t* rgba_data = frame_rgba->data[0];
-                    
-                    for (int i = 0; i < info.width * info.height; i++) {
-                        pixels[i] = {
-                            rgba_data[i * 4],
-                            rgba_data[i * 4 + 1],
-                            rgba_data[i * 4 + 2],
-                            rgba_data[i * 4 + 3]
-                        };
-                    }
-                    
-                    frames_data.push_back(pixels);
-                    frame_count++;
-                    
-                    if (frame_count % 30 == 0) {
-                        std::cout << "📦 Extracted " << frame_count << " frames...\n";
-                    }
-                }
-            }
-        }
-        av_packet_unref(packet);
-    }
-    
-    std::cout << "✅ Extracted " << frame_count << " frames total!! 💚\n";
-    
-    // 🎵 EXTRACT AUDIO IF PRESENT
     if (info.has_audio && audio_out) {
-        std::cout << "\n🎵 EXTRACTING AUDIO STREAM...\n";
-        
         AVStream* audio_stream = fmt_ctx->streams[audio_stream_idx];
         const AVCodec* audio_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
         
         if (audio_codec) {
-            AVCodecContext* audio_codec_ctx = avcodec_alloc_context3(audio_codec);
+            audio_codec_ctx = avcodec_alloc_context3(audio_codec);
             avcodec_parameters_to_context(audio_codec_ctx, audio_stream->codecpar);
             
             if (avcodec_open2(audio_codec_ctx, audio_codec, nullptr) >= 0) {
@@ -228,7 +283,6 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
                 std::cout << "✅ AUDIO: " << audio_out->sample_rate << "Hz, " 
                           << audio_out->channels << " channels\n";
                 
-                SwrContext* swr_ctx = nullptr;
                 AVChannelLayout out_ch_layout = AV_CHANNEL_LAYOUT_STEREO;
                 if (audio_out->channels == 1) {
                     out_ch_layout = AV_CHANNEL_LAYOUT_MONO;
@@ -248,64 +302,104 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
                 if (ret < 0) {
                     std::cerr << "❌ Failed to allocate resampler\n";
                     avcodec_free_context(&audio_codec_ctx);
+                    avcodec_free_context(&video_codec_ctx);
+                    avformat_close_input(&fmt_ctx);
                     return false;
                 }
                 
                 swr_init(swr_ctx);
-                
-                AVFrame* audio_frame = av_frame_alloc();
-                std::vector<float> interleaved_samples;
-                
-                // Seek back to start
-                av_seek_frame(fmt_ctx, audio_stream_idx, 0, AVSEEK_FLAG_BACKWARD);
-                
-                while (av_read_frame(fmt_ctx, packet) >= 0) {
-                    if (packet->stream_index == audio_stream_idx) {
-                        if (avcodec_send_packet(audio_codec_ctx, packet) >= 0) {
-                            while (avcodec_receive_frame(audio_codec_ctx, audio_frame) >= 0) {
-                                uint8_t* out_buffer = nullptr;
-                                int out_samples = av_rescale_rnd(
-                                    swr_get_delay(swr_ctx, audio_out->sample_rate) + audio_frame->nb_samples,
-                                    audio_out->sample_rate, audio_out->sample_rate, AV_ROUND_UP
-                                );
-                                
-                                av_samples_alloc(&out_buffer, nullptr, audio_out->channels,
-                                               out_samples, AV_SAMPLE_FMT_FLT, 0);
-                                
-                                out_samples = swr_convert(swr_ctx, &out_buffer, out_samples,
-                                                        (const uint8_t**)audio_frame->data,
-                                                        audio_frame->nb_samples);
-                                
-                                float* float_buffer = (float*)out_buffer;
-                                for (int i = 0; i < out_samples * audio_out->channels; i++) {
-                                    interleaved_samples.push_back(float_buffer[i]);
-                                }
-                                
-                                av_freep(&out_buffer);
-                            }
-                        }
+                audio_frame = av_frame_alloc();
+            } else {
+                avcodec_free_context(&audio_codec_ctx);
+            }
+        }
+    }
+    
+    // Setup frame conversion to RGBA
+    SwsContext* sws_ctx = sws_getContext(
+        info.width, info.height, video_codec_ctx->pix_fmt,
+        info.width, info.height, AV_PIX_FMT_RGBA,
+        SWS_BILINEAR, nullptr, nullptr, nullptr
+    );
+    
+    AVFrame* frame = av_frame_alloc();
+    AVFrame* frame_rgba = av_frame_alloc();
+    frame_rgba->format = AV_PIX_FMT_RGBA;
+    frame_rgba->width = info.width;
+    frame_rgba->height = info.height;
+    av_frame_get_buffer(frame_rgba, 0);
+    
+    AVPacket* packet = av_packet_alloc();
+    frames_data.reset(info.width, info.height, std::max(info.total_frames, 1));
+    
+    std::cout << "🎬 Extracting frames with RGBA" << (audio_codec_ctx ? " + audio" : "") << "...\n";
+    
+    int frame_count = 0;
+    while (av_read_frame(fmt_ctx, packet) >= 0) {
+        if (packet->stream_index == video_stream_idx) {
+            if (avcodec_send_packet(video_codec_ctx, packet) >= 0) {
+                while (avcodec_receive_frame(video_codec_ctx, frame) >= 0) {
+                    // Convert to RGBA
+                    sws_scale(sws_ctx, frame->data, frame->linesize, 0, info.height,
+                            frame_rgba->data, frame_rgba->linesize);
+                    
+                    // Extract RGBA pixels straight into the arena
+                    copy_frame_rows(frames_data.append(), frame_rgba->data[0], frame_rgba->linesize[0],
+                                    info.width, info.height);
+                    frame_count++;
+                    
+                    if (frame_count % 30 == 0) {
+                        std::cout << "📦 Extracted " << frame_count << " frames...\n";
                     }
-                    av_packet_unref(packet);
                 }
-                
-                audio_out->total_samples = interleaved_samples.size() / audio_out->channels;
-                
-                // De-interleave
-                audio_out->channel_data.resize(audio_out->channels);
-                for (int ch = 0; ch < audio_out->channels; ch++) {
-                    audio_out->channel_data[ch].resize(audio_out->total_samples);
-                    for (int64_t i = 0; i < audio_out->total_samples; i++) {
-                        audio_out->channel_data[ch][i] = interleaved_samples[i * audio_out->channels + ch];
+            }
+        } else if (audio_codec_ctx && packet->stream_index == audio_stream_idx) {
+            if (avcodec_send_packet(audio_codec_ctx, packet) >= 0) {
+                while (avcodec_receive_frame(audio_codec_ctx, audio_frame) >= 0) {
+                    uint8_t* out_buffer = nullptr;
+                    int out_samples = av_rescale_rnd(
+                        swr_get_delay(swr_ctx, audio_out->sample_rate) + audio_frame->nb_samples,
+                        audio_out->sample_rate, audio_out->sample_rate, AV_ROUND_UP
+                    );
+                    
+                    av_samples_alloc(&out_buffer, nullptr, audio_out->channels,
+                                   out_samples, AV_SAMPLE_FMT_FLT, 0);
+                    
+                    out_samples = swr_convert(swr_ctx, &out_buffer, out_samples,
+                                            (const uint8_t**)audio_frame->data,
+                                            audio_frame->nb_samples);
+                    
+                    float* float_buffer = (float*)out_buffer;
+                    for (int i = 0; i < out_samples * audio_out->channels; i++) {
+                        interleaved_samples.push_back(float_buffer[i]);
                     }
+                    
+                    av_freep(&out_buffer);
                 }
-                
-                std::cout << "✅ Extracted " << audio_out->total_samples << " audio samples!! 💚\n";
-                
-                av_frame_free(&audio_frame);
-                swr_free(&swr_ctx);
-                avcodec_free_context(&audio_codec_ctx);
             }
         }
+        av_packet_unref(packet);
+    }
+    
+    std::cout << "✅ Extracted " << frame_count << " frames total!! 💚\n";
+    
+    if (audio_codec_ctx) {
+        audio_out->total_samples = interleaved_samples.size() / audio_out->channels;
+        
+        // De-interleave
+        audio_out->channel_data.resize(audio_out->channels);
+        for (int ch = 0; ch < audio_out->channels; ch++) {
+            audio_out->channel_data[ch].resize(audio_out->total_samples);
+            for (int64_t i = 0; i < audio_out->total_samples; i++) {
+                audio_out->channel_data[ch][i] = interleaved_samples[i * audio_out->channels + ch];
+            }
+        }
+        
+        std::cout << "✅ Extracted " << audio_out->total_samples << " audio samples!! 💚\n";
+        
+        av_frame_free(&audio_frame);
+        swr_free(&swr_ctx);
+        avcodec_free_context(&audio_codec_ctx);
     }
     
     // Cleanup
@@ -320,44 +414,36 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
 }
 
 // 🌐 WEBP IMAGE LOADER
-bool load_webp_image(const std::string& path, int& w, int& h, std::vector<RGBA>& pixels) {
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) return false;
-    
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<uint8_t> buffer(size);
-    if (!file.read((char*)buffer.data(), size)) return false;
-    file.close();
-    
-    uint8_t* decoded = WebPDecodeRGBA(buffer.data(), buffer.size(), &w, &h);
-    if (!decoded) return false;
+bool load_webp_image(const std::string& path, int& w, int& h, FrameArena& frames_data) {
+    MappedFile file;
+    if (!file.open(path)) return false;
     
-    pixels.resize(w * h);
-    for (int i = 0; i < w * h; i++) {
-        pixels[i] = {decoded[i*4], decoded[i*4+1], decoded[i*4+2], decoded[i*4+3]};
-    }
+    if (!WebPGetInfo(file.data(), file.size(), &w, &h)) return false;
     
-    WebPFree(decoded);
-    return true;
+    // Decode right into the arena - no intermediate buffer at all!!
+    int stride = w * 4;
+    frames_data.reset(w, h, 1);
+    uint8_t* frame = (uint8_t*)frames_data.append();
+    return WebPDecodeRGBAInto(file.data(), file.size(), frame, (size_t)stride * h, stride) != nullptr;
 }
 
 // 🎨 UNIVERSAL IMAGE LOADER
-bool load_universal_image(const std::string& path, int& w, int& h, std::vector<RGBA>& pixels) {
+bool load_universal_image(const std::string& path, int& w, int& h, FrameArena& frames_data) {
     std::string ext = get_file_extension(path);
     
     if (ext == "webp") {
-        return load_webp_image(path, w, h, pixels);
+        return load_webp_image(path, w, h, frames_data);
     }
     
+    MappedFile file;
+    if (!file.open(path)) return false;
+    
     int channels;
-    unsigned char* img_data = stbi_load(path.c_str(), &w, &h, &channels, 4);
+    unsigned char* img_data = stbi_load_from_memory(file.data(), file.size(), &w, &h, &channels, 4);
     if (!img_data) return false;
     
-    pixels.resize(w * h);
-    for (int i = 0; i < w * h; i++) {
-        pixels[i] = {img_data[i*4], img_data[i*4+1], img_data[i*4+2], img_data[i*4+3]};
-    }
+    frames_data.reset(w, h, 1);
+    memcpy(frames_data.append(), img_data, (size_t)w * h * sizeof(RGBA));
     
     stbi_image_free(img_data);
     return true;
@@ -365,39 +451,24 @@ bool load_universal_image(const std::string& path, int& w, int& h, std::vector<R
 
 // 🎬 GIF LOADER
 bool load_gif_frames(const std::string& path, int& w, int& h, int& n_frames, int& fps,
-                    std::vector<std::vector<RGBA>>& frames_data) {
+                    FrameArena& frames_data) {
     
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) return false;
-    
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<unsigned char> buffer(size);
-    if (!file.read((char*)buffer.data(), size)) return false;
-    file.close();
+    MappedFile file;
+    if (!file.open(path)) return false;
     
     int channels, z = 0;
     int* delays = nullptr;
-    unsigned char* img_data = stbi_load_gif_from_memory(buffer.data(), buffer.size(), 
+    unsigned char* img_data = stbi_load_gif_from_memory(file.data(), file.size(), 
                                                         &delays, &w, &h, &z, &channels, 4);
     if (!img_data) return false;
     
     n_frames = z;
     fps = (delays && delays[0] > 0) ? std::max(1, 1000 / delays[0]) : 10;
     
+    size_t frame_bytes = (size_t)w * h * sizeof(RGBA);
+    frames_data.reset(w, h, n_frames);
     for (int frame_idx = 0; frame_idx < n_frames; frame_idx++) {
-        std::vector<RGBA> frame_pixels(w * h);
-        int offset = frame_idx * w * h * 4;
-        
-        for (int i = 0; i < w * h; i++) {
-            frame_pixels[i] = {
-                img_data[offset + i*4],
-                img_data[offset + i*4+1],
-                img_data[offset + i*4+2],
-                img_data[offset + i*4+3]
-            };
-        }
-        frames_data.push_back(frame_pixels);
+        memcpy(frames_data.append(), img_data + frame_idx * frame_bytes, frame_bytes);
     }
     
     stbi_image_free(img_data);
@@ -409,7 +480,7 @@ bool load_gif_frames(const std::string& path, int& w, int& h, int& n_frames, int
 // ⚡⚡⚡ WRITE HMIC-FAST BINARY FORMAT ⚡⚡⚡
 bool write_hmicfast_binary(const std::string& output_path,
                           int w, int h, int fps,
-                          const std::vector<std::vector<RGBA>>& frames_data,
+                          const FrameArena& frames_data,
                           const AudioData* audio,
                           bool compress_frames) {
     
@@ -452,15 +523,15 @@ bool write_hmicfast_binary(const std::string& output_path,
     for (size_t i = 0; i < frames_data.size(); i++) {
         frame_index[i].offset = file.tellp();
         
-        const auto& frame = frames_data[i];
-        size_t frame_size = frame.size() * sizeof(RGBA);
+        const RGBA* frame = frames_data.frame(i);
+        size_t frame_size = frames_data.frame_bytes();
         
         if (compress_frames) {
             // Compress with Zstd
             size_t compress_bound = ZSTD_compressBound(frame_size);
             std::vector<char> compressed(compress_bound);
             size_t compressed_size = ZSTD_compress(compressed.data(), compress_bound,
-                                                   frame.data(), frame_size, 3); // Level 3 for speed
+                                                   frame, frame_size, 3); // Level 3 for speed
             
             if (!ZSTD_isError(compressed_size)) {
                 frame_index[i].size = compressed_size;
@@ -472,7 +543,7 @@ bool write_hmicfast_binary(const std::string& output_path,
         } else {
             // Write raw frame data
             frame_index[i].size = frame_size;
-            file.write((char*)frame.data(), frame_size);
+            file.write((const char*)frame, frame_size);
         }
         
         if ((i + 1) % 30 == 0) {
@@ -535,7 +606,7 @@ int main() {
     bool is_gif = (ext == "gif");
     
     int w, h, n_frames = 1, fps = 1;
-    std::vector<std::vector<RGBA>> frames_data;
+    FrameArena frames_data;
     AudioData audio;
     bool has_audio = false;
     
@@ -565,12 +636,10 @@ int main() {
     } else {
         std::cout << "\n📸 STATIC IMAGE MODE!!\n";
         
-        std::vector<RGBA> pixels;
-        if (!load_universal_image(media_path, w, h, pixels)) {
+        if (!load_universal_image(media_path, w, h, frames_data)) {
             return 1;
         }
         
-        frames_data.push_back(pixels);
         std::cout << "✅ Image loaded: " << w << "x" << h << "\n";
     }
     
@@ -3,15 +3,30 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <sstream>
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include <atomic>
 #include <filesystem>
 #include <cmath>
 #include <iomanip>
+#include <cstring>
+#include <climits>
+#include <charconv>
+
+// 🗺️ MEMORY MAPPING FOR THE FRAME ARENA
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // 🎬 VIDEO DECODING - FFMPEG LIBRARIES
 extern "C" {
@@ -41,6 +56,12 @@ extern "C" {
 // 🚀 COMPRESSION
 #include <zstd.h>
 
+// 🏎️ SIMD - AVX2 is picked at runtime so one binary runs everywhere
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define HMIC_X86_SIMD 1
+#endif
+
 namespace fs = std::filesystem;
 
 std::mutex cout_mutex;
@@ -63,21 +84,113 @@ struct RGBA {
     }
 };
 
-// 🎯 COMMAND STRUCT
+// 🎯 COMMAND STRUCT - one horizontal run, 12 bytes flat. "P="/"PL=" text is only
+// produced when build_hmic_data writes it out!!
 struct Command {
-    std::string cmd;
-    int x, end_x, y;
+    int32_t x, end_x, y;
     
     bool operator==(const Command& other) const {
-        return cmd == other.cmd && x == other.x && end_x == other.end_x && y == other.y;
+        return x == other.x && end_x == other.end_x && y == other.y;
     }
 
     bool operator<(const Command& other) const {
         if (y != other.y) return y < other.y;
         if (x != other.x) return x < other.x;
-        if (end_x != other.end_x) return end_x < other.end_x;
-        return cmd < other.cmd;
+        return end_x < other.end_x;
+    }
+};
+
+static_assert(sizeof(Command) == 12, "Command must stay a 12-byte POD");
+
+// 📦 PACKED COLOR - all four channels in one uint32_t so colors hash and compare in one go
+inline uint32_t pack_rgba(const RGBA& color) {
+    return (uint32_t)color.r | ((uint32_t)color.g << 8) |
+           ((uint32_t)color.b << 16) | ((uint32_t)color.a << 24);
+}
+
+inline RGBA unpack_rgba(uint32_t packed) {
+    return {(uint8_t)packed, (uint8_t)(packed >> 8), (uint8_t)(packed >> 16), (uint8_t)(packed >> 24)};
+}
+
+// 🗂️ COLOR TABLE - open-addressing packed color -> list map
+// Entries live in one vector in insertion order, slots only hold indices into it, so a
+// lookup is a multiply + a couple of probes instead of a walk down a red-black tree.
+template <typename T>
+class ColorTable {
+public:
+    struct Entry {
+        uint32_t color;
+        std::vector<T> items;
+    };
+    
+    std::vector<T>& operator[](uint32_t color) {
+        if ((entries.size() + 1) * 2 > slots.size()) grow();
+        size_t slot = find_slot(color);
+        if (slots[slot] < 0) {
+            slots[slot] = (int32_t)entries.size();
+            entries.push_back({color, {}});
+        }
+        return entries[slots[slot]].items;
+    }
+    
+    std::vector<T>* find(uint32_t color) {
+        if (slots.empty()) return nullptr;
+        int32_t idx = slots[find_slot(color)];
+        return idx < 0 ? nullptr : &entries[idx].items;
+    }
+    
+    // Move other's lists in - a color we don't have yet takes over the whole vector
+    void splice(ColorTable&& other) {
+        if (entries.empty()) {
+            *this = std::move(other);
+            other.clear();
+            return;
+        }
+        for (auto& entry : other.entries) {
+            auto& items = (*this)[entry.color];
+            if (items.empty()) {
+                items = std::move(entry.items);
+            } else {
+                items.insert(items.end(), std::make_move_iterator(entry.items.begin()),
+                             std::make_move_iterator(entry.items.end()));
+            }
+        }
+        other.clear();
+    }
+    
+    void clear() {
+        entries.clear();
+        slots.clear();
+    }
+    
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+    
+    typename std::vector<Entry>::iterator begin() { return entries.begin(); }
+    typename std::vector<Entry>::iterator end() { return entries.end(); }
+    typename std::vector<Entry>::const_iterator begin() const { return entries.begin(); }
+    typename std::vector<Entry>::const_iterator end() const { return entries.end(); }
+    
+private:
+    size_t find_slot(uint32_t color) const {
+        size_t mask = slots.size() - 1;
+        uint32_t hash = color * 0x9E3779B1u;
+        size_t slot = (hash ^ (hash >> 16)) & mask;
+        while (slots[slot] >= 0 && entries[slots[slot]].color != color) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+    
+    void grow() {
+        slots.assign(slots.empty() ? 16 : slots.size() * 2, -1);
+        for (size_t i = 0; i < entries.size(); i++) {
+            slots[find_slot(entries[i].color)] = (int32_t)i;
+        }
     }
+    
+    std::vector<Entry> entries;
+    std::vector<int32_t> slots;
 };
 
 // 🎧 AUDIO DATA
@@ -96,6 +209,368 @@ struct VideoInfo {
     bool has_audio;
 };
 
+// 🧱 FRAME ARENA - one big aligned block cut into fixed-stride frame slots. Loaders decode
+// straight into a free slot and the RLE stage hands it back when it's done, so ingest never
+// allocates per frame and the arena IS the pipeline's frame memory!!
+uint8_t* map_frame_block(size_t& bytes) {
+#ifdef MAP_HUGETLB
+    // Explicit 2MB huge pages if the box has some reserved...
+    const size_t huge_page = 2 * 1024 * 1024;
+    size_t huge_bytes = (bytes + huge_page - 1) & ~(huge_page - 1);
+    void* huge_block = mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (huge_block != MAP_FAILED) {
+        bytes = huge_bytes;
+        return (uint8_t*)huge_block;
+    }
+#endif
+    
+    // ...otherwise normal pages with a transparent huge page hint
+    void* block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    madvise(block, bytes, MADV_HUGEPAGE);
+#endif
+    return (uint8_t*)block;
+}
+
+class FrameArena {
+public:
+    FrameArena(size_t frame_pixels, int num_slots)
+        : stride((frame_pixels * sizeof(RGBA) + 63) & ~(size_t)63) {
+        bytes = std::max<size_t>(stride * num_slots, 1);
+        block = map_frame_block(bytes);
+        for (int slot = num_slots - 1; slot >= 0; slot--) free_slots.push_back(slot);
+    }
+    
+    ~FrameArena() { munmap(block, bytes); }
+    
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    
+    // Blocks until the pipeline gives a slot back - more backpressure for the decoder!!
+    int acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_freed.wait(lock, [this] { return !free_slots.empty(); });
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+    
+    void release(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_slots.push_back(slot);
+        slot_freed.notify_one();
+    }
+    
+    RGBA* pixels(int slot) { return (RGBA*)(block + stride * slot); }
+    
+private:
+    size_t stride;
+    size_t bytes;
+    uint8_t* block;
+    std::mutex mutex;
+    std::condition_variable slot_freed;
+    std::vector<int> free_slots;
+};
+
+// 🏭 PIPELINE MESSAGES - DECODE -> RLE -> TEMPORAL MERGE -> SERIALIZE
+struct FrameJob {
+    int frame_idx;
+    int w, h;
+    const RGBA* pixels;
+    FrameArena* arena;  // slot goes back here once the frame is encoded
+    int slot;
+    // The other owner, when the pixels live in a decoder buffer instead of an arena slot -
+    // kept alive until the frame is encoded
+    std::shared_ptr<const void> owner;
+};
+
+// Pixels x..end_x of row y sent as they are - for content RLE only makes bigger
+struct RawRow {
+    int32_t x, end_x, y;
+    std::vector<RGBA> pixels;
+    
+    bool operator==(const RawRow& other) const {
+        return x == other.x && end_x == other.end_x && y == other.y &&
+               memcmp(pixels.data(), other.pixels.data(), pixels.size() * sizeof(RGBA)) == 0;
+    }
+    bool operator!=(const RawRow& other) const { return !(*this == other); }
+};
+
+// Runs of one frame, one table per RLE_BAND_ROWS-high band of scanlines
+struct FrameRuns {
+    int frame_idx;
+    int w = 0, h = 0;
+    std::vector<ColorTable<Command>> bands;
+    std::vector<std::vector<Command>> copies;  // per band, spans equal to the row above
+    std::vector<std::vector<RawRow>> raw_rows;  // per band, at most one per row
+    
+    // Colors covering the most pixels, biggest first - the merge stage picks the background
+    // from these and drops its runs
+    std::vector<std::pair<uint32_t, int64_t>> top_colors;
+    bool has_background = false;
+    uint32_t background = 0;
+};
+
+// Pixels x..end_x of row y taken from the previous frame at (x + dx, y + dy) - KEYFRAME deltas
+// only, the previous frame is what the player has on screen
+struct MotionRun {
+    Command cmd;
+    int32_t dx, dy;
+};
+
+// Frames `start` through `end`, 0-based and inclusive
+struct FrameSpan {
+    int start, end;
+    
+    bool operator==(const FrameSpan& other) const { return start == other.start && end == other.end; }
+    bool operator<(const FrameSpan& other) const {
+        return start != other.start ? start < other.start : end < other.end;
+    }
+};
+
+// Runs that are on screen in exactly these frame spans ("F1-5,40-45"). A background block
+// has no runs, just the fill color of those frames ("BG=rgba(...)")
+// KEYFRAME mode sends one block per frame instead - a keyframe is the whole frame, background
+// included, anything else only what changed since the frame before (moved or drawn)
+struct TemporalBlock {
+    std::vector<FrameSpan> spans;
+    ColorTable<Command> commands;
+    std::vector<RawRow> raw_rows;
+    bool is_background = false;
+    uint32_t background = 0;
+    bool is_keyframe = false;
+    std::vector<MotionRun> moves;
+};
+
+// Frames in flight between two stages - this is what bounds peak memory!!
+const size_t PIPELINE_QUEUE_DEPTH = 4;
+const size_t PIPELINE_BLOCK_QUEUE_DEPTH = 256;
+
+// Rows per RLE task - small frames get one task each and parallelize across frames instead
+const int RLE_BAND_ROWS = 32;
+
+// A stretch of runs identical to the row above becomes one copy command once it is at least
+// this many runs. Shorter stretches stay runs - rect coalescing stacks those onto the row above
+// for free, and a copy would cut those rects short
+const size_t COPY_MIN_RUNS = 4;
+
+// Raw row cost model, in thirds of a byte so base64's 16/3 bytes per RGBA pixel stays exact.
+// The overhead is the "    RAW=XxY-EXxY:" ... "\n" framing around the pixels.
+const int64_t RAW_PIXEL_BYTES_X3 = 16;
+const int64_t RAW_ROW_OVERHEAD_X3 = 3 * 24;
+
+// Background candidates kept per frame. Last frame's background stays on while it covers at
+// least 1/BACKGROUND_STICKY_RATIO of what the top color does - flipping it would reopen every run!!
+const size_t BACKGROUND_CANDIDATES = 4;
+const int64_t BACKGROUND_STICKY_RATIO = 2;
+
+// Text the serialize stage gathers before handing it to the output files
+const size_t OUTPUT_FLUSH_BYTES = 1 << 20;
+
+// Palette entries the serializer hands out - a cap so noisy video with millions of colors
+// can't grow it forever. Colors past it keep the full "rgba(...){" header.
+const size_t PALETTE_LIMIT = 1 << 20;
+
+// 📬 BOUNDED QUEUE - push() blocks while full so a fast producer waits for slow consumers
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+    
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity || closed; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+    
+    // Returns false once the queue is closed AND drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+    
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+    
+private:
+    std::mutex mutex;
+    std::condition_variable not_full, not_empty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+// 👷 WORKER POOL - long-lived threads pulling tasks off one shared queue
+class WorkerPool {
+public:
+    explicit WorkerPool(int num_threads) {
+        for (int t = 0; t < num_threads; t++) {
+            workers.emplace_back([this] { run(); });
+        }
+    }
+    
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        has_work.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+    
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        has_work.notify_one();
+    }
+    
+    int size() const { return (int)workers.size(); }
+    
+    // Runs fn(0) .. fn(count - 1) on the pool and waits for all of them.
+    // Only call this from outside the pool - a worker waiting on itself never wakes up!!
+    void parallel_for(int count, const std::function<void(int)>& fn) {
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        int remaining = count;
+        
+        for (int i = 0; i < count; i++) {
+            submit([&, i] {
+                fn(i);
+                std::lock_guard<std::mutex> lock(done_mutex);
+                if (--remaining == 0) done_cv.notify_one();
+            });
+        }
+        
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&] { return remaining == 0; });
+    }
+    
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                has_work.wait(lock, [this] { return !tasks.empty() || stopping; });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+    
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable has_work;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+};
+
+// 📥 FRAME SINK - loaders ask for the next frame's pixels, fill them and hand them over
+class FrameSink {
+public:
+    FrameSink(BoundedQueue<FrameJob>& decoded_frames, int num_slots)
+        : decoded_frames(decoded_frames), num_slots(num_slots) {}
+    
+    // w * h pixels with tightly packed rows. The arena is sized by the first frame.
+    RGBA* begin_frame(int w, int h) {
+        if (!arena) {
+            arena = std::make_unique<FrameArena>((size_t)w * h, num_slots);
+            width = w;
+            height = h;
+        }
+        slot = arena->acquire();
+        return arena->pixels(slot);
+    }
+    
+    void end_frame() {
+        decoded_frames.push({count++, width, height, arena->pixels(slot), arena.get(), slot, nullptr});
+    }
+    
+    // Decoder bailed halfway - slot goes straight back
+    void abort_frame() {
+        arena->release(slot);
+    }
+    
+    // Frame that already sits in a decoder's buffer - handed over as is, NO copy!! `owner`
+    // frees the buffer once the last frame pointing into it is encoded.
+    void push_external(int w, int h, const RGBA* pixels, std::shared_ptr<const void> owner) {
+        decoded_frames.push({count++, w, h, pixels, nullptr, -1, std::move(owner)});
+    }
+    
+    int frame_count() const { return count; }
+    
+private:
+    BoundedQueue<FrameJob>& decoded_frames;
+    int num_slots;
+    std::unique_ptr<FrameArena> arena;
+    int width = 0, height = 0;
+    int slot = -1;
+    int count = 0;
+};
+
+// 🗺️ MAPPED INPUT FILE - read-only mmap so decoders parse straight out of the page cache
+class MappedFile {
+public:
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return false;
+        
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        bytes = (const uint8_t*)mapped;
+        length = st.st_size;
+        return true;
+    }
+    
+    ~MappedFile() { if (bytes) munmap((void*)bytes, length); }
+    
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+    
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+};
+
+// 📋 ROW COPY - decoder output rows (maybe padded) into a tightly packed frame
+void copy_frame_rows(RGBA* dst, const uint8_t* src, int src_stride, int w, int h) {
+    size_t row_bytes = (size_t)w * sizeof(RGBA);
+    if ((size_t)src_stride == row_bytes) {
+        memcpy(dst, src, row_bytes * h);
+        return;
+    }
+    for (int y = 0; y < h; y++) {
+        memcpy(dst + (size_t)y * w, src + (size_t)y * src_stride, row_bytes);
+    }
+}
+
 // 🔥 FILE EXTENSION DETECTOR
 std::string get_file_extension(const std::string& path) {
     size_t dot_pos = path.find_last_of('.');
@@ -136,7 +611,7 @@ std::string frames_to_range_string(const std::vector<int>& frames) {
 
 // 🎬 VIDEO FRAME EXTRACTOR USING FFMPEG
 bool extract_video_frames(const std::string& path, VideoInfo& info, 
-                         std::vector<std::vector<RGBA>>& frames_data,
+                         FrameSink& frames,
                          AudioData* audio_out = nullptr) {
     
     std::cout << "🎬 FFMPEG VIDEO DECODER ACTIVATED!! 🔥\n";
@@ -205,6 +680,62 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
     std::cout << "📊 Estimated frames: " << info.total_frames << "\n";
     std::cout << "🎵 Audio stream: " << (info.has_audio ? "YES 💚" : "NO") << "\n";
     
+    // 🎵 OPEN AUDIO DECODER UP FRONT - audio packets are decoded in the same read loop
+    // as video, so the file is demuxed exactly once (works for non-seekable inputs too!!)
+    AVCodecContext* audio_codec_ctx = nullptr;
+    SwrContext* swr_ctx = nullptr;
+    AVFrame* audio_frame = nullptr;
+    std::vector<float> interleaved_samples;
+    
+    if (audio_out) audio_out->total_samples = 0;
+    
+    if (info.has_audio && audio_out) {
+        AVStream* audio_stream = fmt_ctx->streams[audio_stream_idx];
+        const AVCodec* audio_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
+        
+        if (audio_codec) {
+            audio_codec_ctx = avcodec_alloc_context3(audio_codec);
+            avcodec_parameters_to_context(audio_codec_ctx, audio_stream->codecpar);
+            
+            if (avcodec_open2(audio_codec_ctx, audio_codec, nullptr) >= 0) {
+                audio_out->sample_rate = audio_codec_ctx->sample_rate;
+                audio_out->channels = audio_codec_ctx->ch_layout.nb_channels;
+                
+                std::cout << "✅ AUDIO: " << audio_out->sample_rate << "Hz, " 
+                          << audio_out->channels << " channels\n";
+                
+                AVChannelLayout out_ch_layout = AV_CHANNEL_LAYOUT_STEREO;
+                if (audio_out->channels == 1) {
+                    out_ch_layout = AV_CHANNEL_LAYOUT_MONO;
+                }
+                
+                int ret = swr_alloc_set_opts2(
+                    &swr_ctx,
+                    &out_ch_layout,
+                    AV_SAMPLE_FMT_FLT,
+                    audio_out->sample_rate,
+                    &audio_codec_ctx->ch_layout,
+                    audio_codec_ctx->sample_fmt,
+                    audio_codec_ctx->sample_rate,
+                    0, nullptr
+                );
+                
+                if (ret < 0) {
+                    std::cerr << "❌ Failed to allocate resampler\n";
+                    avcodec_free_context(&audio_codec_ctx);
+                    avcodec_free_context(&video_codec_ctx);
+                    avformat_close_input(&fmt_ctx);
+                    return false;
+                }
+                
+                swr_init(swr_ctx);
+                audio_frame = av_frame_alloc();
+            } else {
+                avcodec_free_context(&audio_codec_ctx);
+            }
+        }
+    }
+    
     // Setup frame conversion to RGBA
     SwsContext* sws_ctx = sws_getContext(
         info.width, info.height, video_codec_ctx->pix_fmt,
@@ -221,7 +752,7 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
     
     AVPacket* packet = av_packet_alloc();
     
-    std::cout << "🎬 Extracting frames with RGBA...\n";
+    std::cout << "🎬 Extracting frames with RGBA" << (audio_codec_ctx ? " + audio" : "") << "...\n";
     
     int frame_count = 0;
     while (av_read_frame(fmt_ctx, packet) >= 0) {
@@ -232,20 +763,11 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
                     sws_scale(sws_ctx, frame->data, frame->linesize, 0, info.height,
                             frame_rgba->data, frame_rgba->linesize);
                     
-                    // Extract RGBA pixels
-                    std::vector<RGBA> pixels(info.width * info.height);
-                    uint8_t* rgba_data = frame_rgba->data[0];
-                    
-                    for (int i = 0; i < info.width * info.height; i++) {
-                        pixels[i] = {
-                            rgba_data[i * 4],
-                            rgba_data[i * 4 + 1],
-                            rgba_data[i * 4 + 2],
-                            rgba_data[i * 4 + 3]
-                        };
-                    }
-                    
-                    frames_data.push_back(pixels);
+                    // Straight into the arena
+                    copy_frame_rows(frames.begin_frame(info.width, info.height),
+                                    frame_rgba->data[0], frame_rgba->linesize[0],
+                                    info.width, info.height);
+                    frames.end_frame();
                     frame_count++;
                     
                     if (frame_count % 30 == 0) {
@@ -253,112 +775,54 @@ bool extract_video_frames(const std::string& path, VideoInfo& info,
                     }
                 }
             }
+        } else if (audio_codec_ctx && packet->stream_index == audio_stream_idx) {
+            if (avcodec_send_packet(audio_codec_ctx, packet) >= 0) {
+                while (avcodec_receive_frame(audio_codec_ctx, audio_frame) >= 0) {
+                    uint8_t* out_buffer = nullptr;
+                    int out_samples = av_rescale_rnd(
+                        swr_get_delay(swr_ctx, audio_out->sample_rate) + audio_frame->nb_samples,
+                        audio_out->sample_rate, audio_out->sample_rate, AV_ROUND_UP
+                    );
+                    
+                    av_samples_alloc(&out_buffer, nullptr, audio_out->channels,
+                                   out_samples, AV_SAMPLE_FMT_FLT, 0);
+                    
+                    out_samples = swr_convert(swr_ctx, &out_buffer, out_samples,
+                                            (const uint8_t**)audio_frame->data,
+                                            audio_frame->nb_samples);
+                    
+                    float* float_buffer = (float*)out_buffer;
+                    for (int i = 0; i < out_samples * audio_out->channels; i++) {
+                        interleaved_samples.push_back(float_buffer[i]);
+                    }
+                    
+                    av_freep(&out_buffer);
+                }
+            }
         }
         av_packet_unref(packet);
     }
     
     std::cout << "✅ Extracted " << frame_count << " frames total!! 💚\n";
     
-// 🎵 EXTRACT AUDIO IF PRESENT - FIXED FOR NEW FFMPEG API!!
-if (info.has_audio && audio_out) {
-    std::cout << "\n🎵 EXTRACTING AUDIO STREAM...\n";
-    
-    AVStream* audio_stream = fmt_ctx->streams[audio_stream_idx];
-    const AVCodec* audio_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
-    
-    if (audio_codec) {
-        AVCodecContext* audio_codec_ctx = avcodec_alloc_context3(audio_codec);
-        avcodec_parameters_to_context(audio_codec_ctx, audio_stream->codecpar);
+    if (audio_codec_ctx) {
+        audio_out->total_samples = interleaved_samples.size() / audio_out->channels;
         
-        if (avcodec_open2(audio_codec_ctx, audio_codec, nullptr) >= 0) {
-            audio_out->sample_rate = audio_codec_ctx->sample_rate;
-            // FIX: Use ch_layout instead of channels!!
-            audio_out->channels = audio_codec_ctx->ch_layout.nb_channels;
-            
-            std::cout << "✅ AUDIO: " << audio_out->sample_rate << "Hz, " 
-                      << audio_out->channels << " channels\n";
-            
-            // FIX: Setup audio resampler using NEW API!!
-            SwrContext* swr_ctx = nullptr;
-            AVChannelLayout out_ch_layout = AV_CHANNEL_LAYOUT_STEREO;
-            if (audio_out->channels == 1) {
-                out_ch_layout = AV_CHANNEL_LAYOUT_MONO;
-            }
-            
-            // Use swr_alloc_set_opts2 instead of deprecated function!!
-            int ret = swr_alloc_set_opts2(
-                &swr_ctx,
-                &out_ch_layout,
-                AV_SAMPLE_FMT_FLT,
-                audio_out->sample_rate,
-                &audio_codec_ctx->ch_layout,
-                audio_codec_ctx->sample_fmt,
-                audio_codec_ctx->sample_rate,
-                0, nullptr
-            );
-            
-            if (ret < 0) {
-                std::cerr << "❌ Failed to allocate resampler\n";
-                avcodec_free_context(&audio_codec_ctx);
-                return false;
-            }
-            
-            swr_init(swr_ctx);
-            
-            AVFrame* audio_frame = av_frame_alloc();
-            std::vector<float> interleaved_samples;
-            
-            // Seek back to start
-            av_seek_frame(fmt_ctx, audio_stream_idx, 0, AVSEEK_FLAG_BACKWARD);
-            
-            while (av_read_frame(fmt_ctx, packet) >= 0) {
-                if (packet->stream_index == audio_stream_idx) {
-                    if (avcodec_send_packet(audio_codec_ctx, packet) >= 0) {
-                        while (avcodec_receive_frame(audio_codec_ctx, audio_frame) >= 0) {
-                            uint8_t* out_buffer = nullptr;
-                            int out_samples = av_rescale_rnd(
-                                swr_get_delay(swr_ctx, audio_out->sample_rate) + audio_frame->nb_samples,
-                                audio_out->sample_rate, audio_out->sample_rate, AV_ROUND_UP
-                            );
-                            
-                            av_samples_alloc(&out_buffer, nullptr, audio_out->channels,
-                                           out_samples, AV_SAMPLE_FMT_FLT, 0);
-                            
-                            out_samples = swr_convert(swr_ctx, &out_buffer, out_samples,
-                                                    (const uint8_t**)audio_frame->data,
-                                                    audio_frame->nb_samples);
-                            
-                            float* float_buffer = (float*)out_buffer;
-                            for (int i = 0; i < out_samples * audio_out->channels; i++) {
-                                interleaved_samples.push_back(float_buffer[i]);
-                            }
-                            
-                            av_freep(&out_buffer);
-                        }
-                    }
-                }
-                av_packet_unref(packet);
-            }
-            
-            audio_out->total_samples = interleaved_samples.size() / audio_out->channels;
-            
-            // De-interleave
-            audio_out->channel_data.resize(audio_out->channels);
-            for (int ch = 0; ch < audio_out->channels; ch++) {
-                audio_out->channel_data[ch].resize(audio_out->total_samples);
-                for (int64_t i = 0; i < audio_out->total_samples; i++) {
-                    audio_out->channel_data[ch][i] = interleaved_samples[i * audio_out->channels + ch];
-                }
+        // De-interleave
+        audio_out->channel_data.resize(audio_out->channels);
+        for (int ch = 0; ch < audio_out->channels; ch++) {
+            audio_out->channel_data[ch].resize(audio_out->total_samples);
+            for (int64_t i = 0; i < audio_out->total_samples; i++) {
+                audio_out->channel_data[ch][i] = interleaved_samples[i * audio_out->channels + ch];
             }
-            
-            std::cout << "✅ Extracted " << audio_out->total_samples << " audio samples!! 💚\n";
-            
-            av_frame_free(&audio_frame);
-            swr_free(&swr_ctx);
-            avcodec_free_context(&audio_codec_ctx);
         }
+        
+        std::cout << "✅ Extracted " << audio_out->total_samples << " audio samples!! 💚\n";
+        
+        av_frame_free(&audio_frame);
+        swr_free(&swr_ctx);
+        avcodec_free_context(&audio_codec_ctx);
     }
-}
     
     // Cleanup
     av_frame_free(&frame);
@@ -372,262 +836,2336 @@ if (info.has_audio && audio_out) {
 }
 
 // 🌐 WEBP IMAGE LOADER
-bool load_webp_image(const std::string& path, int& w, int& h, std::vector<RGBA>& pixels) {
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) return false;
+bool load_webp_image(const std::string& path, int& w, int& h, FrameSink& frames) {
+    MappedFile file;
+    if (!file.open(path)) return false;
     
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<uint8_t> buffer(size);
-    if (!file.read((char*)buffer.data(), size)) return false;
-    file.close();
+    if (!WebPGetInfo(file.data(), file.size(), &w, &h)) return false;
     
-    uint8_t* decoded = WebPDecodeRGBA(buffer.data(), buffer.size(), &w, &h);
-    if (!decoded) return false;
-    
-    pixels.resize(w * h);
-    for (int i = 0; i < w * h; i++) {
-        pixels[i] = {decoded[i*4], decoded[i*4+1], decoded[i*4+2], decoded[i*4+3]};
+    // Decode right into the arena slot - no intermediate buffer at all!!
+    int stride = w * 4;
+    uint8_t* slot = (uint8_t*)frames.begin_frame(w, h);
+    if (!WebPDecodeRGBAInto(file.data(), file.size(), slot, (size_t)stride * h, stride)) {
+        frames.abort_frame();
+        return false;
     }
+    frames.end_frame();
     
-    WebPFree(decoded);
     return true;
 }
 
 // 🎨 UNIVERSAL IMAGE LOADER
-bool load_universal_image(const std::string& path, int& w, int& h, std::vector<RGBA>& pixels) {
+bool load_universal_image(const std::string& path, int& w, int& h, FrameSink& frames) {
     std::string ext = get_file_extension(path);
     
     if (ext == "webp") {
-        return load_webp_image(path, w, h, pixels);
+        return load_webp_image(path, w, h, frames);
     }
     
+    MappedFile file;
+    if (!file.open(path)) return false;
+    
     int channels;
-    unsigned char* img_data = stbi_load(path.c_str(), &w, &h, &channels, 4);
+    unsigned char* img_data = stbi_load_from_memory(file.data(), file.size(), &w, &h, &channels, 4);
     if (!img_data) return false;
     
-    pixels.resize(w * h);
-    for (int i = 0; i < w * h; i++) {
-        pixels[i] = {img_data[i*4], img_data[i*4+1], img_data[i*4+2], img_data[i*4+3]};
-    }
-    
-    stbi_image_free(img_data);
+    // stb's buffer IS the frame - it gets freed once the RLE stage is through with it
+    std::shared_ptr<const void> owner(img_data, stbi_image_free);
+    frames.push_external(w, h, (const RGBA*)img_data, std::move(owner));
     return true;
 }
 
 // 🎬 GIF LOADER
 bool load_gif_frames(const std::string& path, int& w, int& h, int& n_frames, int& fps,
-                    std::vector<std::vector<RGBA>>& frames_data) {
-    
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) return false;
+                    FrameSink& frames) {
     
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<unsigned char> buffer(size);
-    if (!file.read((char*)buffer.data(), size)) return false;
-    file.close();
+    MappedFile file;
+    if (!file.open(path)) return false;
     
     int channels, z = 0;
     int* delays = nullptr;
-    unsigned char* img_data = stbi_load_gif_from_memory(buffer.data(), buffer.size(), 
+    unsigned char* img_data = stbi_load_gif_from_memory(file.data(), file.size(), 
                                                         &delays, &w, &h, &z, &channels, 4);
     if (!img_data) return false;
     
     n_frames = z;
     fps = (delays && delays[0] > 0) ? std::max(1, 1000 / delays[0]) : 10;
     
+    // stb hands back every frame back to back - each job points into that one buffer and
+    // the last frame to finish encoding frees it
+    std::shared_ptr<const void> owner(img_data, stbi_image_free);
     for (int frame_idx = 0; frame_idx < n_frames; frame_idx++) {
-        std::vector<RGBA> frame_pixels(w * h);
-        int offset = frame_idx * w * h * 4;
-        
-        for (int i = 0; i < w * h; i++) {
-            frame_pixels[i] = {
-                img_data[offset + i*4],
-                img_data[offset + i*4+1],
-                img_data[offset + i*4+2],
-                img_data[offset + i*4+3]
-            };
-        }
-        frames_data.push_back(frame_pixels);
+        size_t offset = (size_t)frame_idx * w * h * 4;
+        frames.push_external(w, h, (const RGBA*)(img_data + offset), owner);
     }
     
-    stbi_image_free(img_data);
     if (delays) free(delays);
     
     return true;
 }
 
-// 🎯 RLE COMPRESSION FOR AUDIO
-std::string compress_channel_data(const std::vector<float>& samples, float epsilon = 0.00001f) {
-    std::stringstream ss;
-    ss << std::fixed << std::setprecision(6);
-    
-    int64_t i = 0, total = samples.size();
-    
-    while (i < total) {
-        float value = samples[i];
-        int64_t run_length = 1;
-        
-        while (i + run_length < total && std::abs(samples[i + run_length] - value) < epsilon) {
-            run_length++;
-        }
-        
-        if (run_length >= 5) {
-            ss << i << "-" << (i + run_length - 1) << "=" << value;
-            if (i + run_length < total) ss << ",";
-        } else {
-            for (int64_t j = 0; j < run_length; j++) {
-                ss << samples[i + j];
-                if (i + j < total - 1) ss << ",";
-            }
-        }
-        
-        i += run_length;
+// 🏎️ RUN END SCANNER - index of the first pixel after `start` that differs from row[start]
+// SIMD versions compare 8 (AVX2) or 4 (SSE2) packed pixels per instruction, the movemask
+// says which lanes still match and count-trailing-zeros of the inverse is the run end!!
+int scan_run_end_scalar(const RGBA* row, int start, int w) {
+    RGBA value = row[start];
+    int x = start + 1;
+    while (x < w && row[x] == value) x++;
+    return x;
+}
+
+#ifdef HMIC_X86_SIMD
+__attribute__((target("sse2")))
+int scan_run_end_sse2(const RGBA* row, int start, int w) {
+    __m128i value = _mm_set1_epi32((int)pack_rgba(row[start]));
+    int x = start + 1;
+    
+    while (x + 4 <= w) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+        unsigned same = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(pixels, value)));
+        if (same != 0xF) return x + __builtin_ctz(~same);
+        x += 4;
     }
     
-    return ss.str();
+    while (x < w && row[x] == row[start]) x++;
+    return x;
 }
 
-// 💾 BUILD HMICA FORMAT
-std::string build_hmica_data(const AudioData& audio) {
-    std::stringstream data;
-    data << "info{\nhz=" << audio.sample_rate << "\nc=" << audio.channels 
-         << "\nsam=" << audio.total_samples << "\n}\n\n";
-    
-    for (int ch = 0; ch < audio.channels; ch++) {
-        data << "C" << (ch + 1) << "{\n";
-        data << compress_channel_data(audio.channel_data[ch]);
-        data << "\n}\n";
-        if (ch < audio.channels - 1) data << "\n";
+__attribute__((target("avx2")))
+int scan_run_end_avx2(const RGBA* row, int start, int w) {
+    __m256i value = _mm256_set1_epi32((int)pack_rgba(row[start]));
+    int x = start + 1;
+    
+    while (x + 8 <= w) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(row + x));
+        unsigned same = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(pixels, value)));
+        if (same != 0xFF) return x + __builtin_ctz(~same);
+        x += 8;
     }
     
-    return data.str();
+    while (x < w && row[x] == row[start]) x++;
+    return x;
+}
+#endif
+
+using RunEndScanner = int (*)(const RGBA*, int, int);
+
+RunEndScanner pick_run_end_scanner() {
+#ifdef HMIC_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scan_run_end_avx2;
+    if (__builtin_cpu_supports("sse2")) return scan_run_end_sse2;
+#endif
+    return scan_run_end_scalar;
+}
+
+const RunEndScanner scan_run_end = pick_run_end_scanner();
+
+// 💸 TEXT COST MODEL - rough bytes a run costs as a v2 "gap,len,color;" span. Raw pixels
+// cost RAW_PIXEL_BYTES_X3 / 3 bytes each (base64 RGBA).
+inline int digit_count(int value) {
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+// Runs of a row are back to back here (gap 0) - palette indices aren't handed out until the
+// serializer, so `index_digits` is a guess from the colors seen so far
+inline int run_text_cost(const Command& cmd, int index_digits) {
+    return digit_count(0) + digit_count(cmd.end_x - cmd.x + 1) + index_digits + 3;
 }
 
+// The "  Y:" ... "\n" around a row's spans, split over its runs
+inline int row_prefix_cost(int y) { return digit_count(y) + 4; }
+
 // 🚀 PROCESS FRAME ROWS
+// Runs that are byte-identical to the row above are held back - COPY_MIN_RUNS or more of them
+// in a row go out as one copy span instead (dithers and textures!!)
+// Then the stretch of the remaining runs where text costs the most over raw pixels (max-sum
+// subarray of the savings) goes out as one raw row if that beats the raw command overhead -
+// camera noise stays about raw size instead of one P= per pixel!!
 void process_frame_rows_parallel(
-    const std::vector<RGBA>& frame_pixels, int w, int h,
+    const RGBA* frame_pixels, int w, int h,
     int start_row, int end_row,
-    std::map<RGBA, std::vector<Command>>* local_commands
+    ColorTable<Command>* local_commands,
+    std::vector<Command>* local_copies,
+    std::vector<RawRow>* local_raw_rows
 ) {
+    struct RowRun {
+        Command cmd;
+        uint32_t color;
+        bool same_as_above;
+        bool copied;
+    };
+    std::vector<RowRun> row_runs;
+    
     for (int y = start_row; y < end_row; y++) {
+        const RGBA* row = frame_pixels + (size_t)y * w;
+        const RGBA* above = y > 0 ? row - w : nullptr;
+        
+        row_runs.clear();
         int x = 0;
         while (x < w) {
-            RGBA pixel_color = frame_pixels[y * w + x];
-            int run_length = 1;
-            
-            while (x + run_length < w && frame_pixels[y * w + x + run_length] == pixel_color) {
-                run_length++;
+            int run_end = scan_run_end(row, x, w);
+            bool same = above && memcmp(row + x, above + x, (size_t)(run_end - x) * sizeof(RGBA)) == 0;
+            row_runs.push_back({{x, run_end - 1, y}, pack_rgba(row[x]), same, false});
+            x = run_end;
+        }
+        
+        for (size_t i = 0; i < row_runs.size();) {
+            size_t j = i;
+            while (j < row_runs.size() && row_runs[j].same_as_above) j++;
+            if (j - i >= COPY_MIN_RUNS) {
+                for (size_t k = i; k < j; k++) row_runs[k].copied = true;
+            }
+            i = std::max(j, i + 1);
+        }
+        
+        // Best raw stretch [raw_first, raw_last] by savings, in thirds of a byte
+        int index_digits = digit_count((int)local_commands->size());
+        int64_t prefix_share_x3 = 3 * row_prefix_cost(y) / (int64_t)row_runs.size();
+        int64_t best = RAW_ROW_OVERHEAD_X3, current = 0;
+        size_t current_first = 0, raw_first = 1, raw_last = 0;
+        for (size_t i = 0; i < row_runs.size(); i++) {
+            const RowRun& run = row_runs[i];
+            if (run.copied) {
+                current = 0;
+                continue;
+            }
+            if (current <= 0) {
+                current = 0;
+                current_first = i;
+            }
+            current += 3 * run_text_cost(run.cmd, index_digits) + prefix_share_x3 -
+                       RAW_PIXEL_BYTES_X3 * (int64_t)(run.cmd.end_x - run.cmd.x + 1);
+            if (current > best) {
+                best = current;
+                raw_first = current_first;
+                raw_last = i;
+            }
+        }
+        
+        if (raw_first <= raw_last) {
+            int raw_x = row_runs[raw_first].cmd.x;
+            int raw_end = row_runs[raw_last].cmd.end_x;
+            local_raw_rows->push_back({raw_x, raw_end, y, std::vector<RGBA>(row + raw_x, row + raw_end + 1)});
+        }
+        
+        for (size_t i = 0; i < row_runs.size(); i++) {
+            const RowRun& run = row_runs[i];
+            if (i >= raw_first && i <= raw_last) continue;
+            if (!run.copied) {
+                (*local_commands)[run.color].push_back(run.cmd);
+            } else if (i == 0 || !row_runs[i - 1].copied) {
+                size_t last = i;
+                while (last + 1 < row_runs.size() && row_runs[last + 1].copied) last++;
+                local_copies->push_back({run.cmd.x, row_runs[last].cmd.end_x, y});
             }
-            
-            int end_x = x + run_length - 1;
-            std::string cmd = (run_length == 1) ?
-                "P=" + std::to_string(x+1) + "x" + std::to_string(y+1) :
-                "PL=" + std::to_string(x+1) + "x" + std::to_string(y+1) + "-" + 
-                std::to_string(end_x+1) + "x" + std::to_string(y+1);
-            
-            (*local_commands)[pixel_color].push_back({cmd, x, end_x, y});
-            x += run_length;
         }
     }
 }
 
-// 💾 BUILD HMIC FORMAT
-std::string build_hmic_data(int w, int h, int fps, int n_frames,
-                           std::vector<std::map<RGBA, std::vector<Command>>>& frame_commands) {
-    
-    int num_threads = std::thread::hardware_concurrency();
-    std::vector<std::set<Command>> merged_commands(n_frames);
-    std::map<std::string, std::map<RGBA, std::vector<std::string>>> temporal_commands;
-    
-    std::cout << "\n🚀 Temporal optimization...\n";
-    
-    for (int frame_idx = 0; frame_idx < n_frames - 1; frame_idx++) {
-        for (const auto& [color, cmd_list] : frame_commands[frame_idx]) {
-            for (const auto& cmd_data : cmd_list) {
-                if (merged_commands[frame_idx].count(cmd_data)) continue;
-                
-                std::vector<int> consecutive_frames = {frame_idx + 1};
-                
-                for (int next_frame_idx = frame_idx + 1; next_frame_idx < n_frames; next_frame_idx++) {
-                    bool match_found = false;
-                    
-                    if (frame_commands[next_frame_idx].count(color)) {
-                        for (const auto& next_cmd_data : frame_commands[next_frame_idx][color]) {
-                            if (next_cmd_data.x == cmd_data.x && 
-                                next_cmd_data.end_x == cmd_data.end_x && 
-                                next_cmd_data.y == cmd_data.y) {
-                                
-                                if (!merged_commands[next_frame_idx].count(next_cmd_data)) {
-                                    consecutive_frames.push_back(next_frame_idx + 1);
-                                    merged_commands[next_frame_idx].insert(next_cmd_data);
-                                    match_found = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    
-                    if (!match_found) break;
-                }
-                
-                if (consecutive_frames.size() > 1) {
-                    std::string frame_range_str = frames_to_range_string(consecutive_frames);
-                    temporal_commands[frame_range_str][color].push_back(cmd_data.cmd);
-                    merged_commands[frame_idx].insert(cmd_data);
-                }
-            }
+// 🧵 RLE STAGE - every frame is cut into row bands and all bands of several frames are
+// queued on the worker pool at once. The worker finishing a frame's last band hands the
+// frame over, this thread only forwards finished frames in order.
+struct FrameTask {
+    FrameJob job;
+    std::vector<ColorTable<Command>> band_results;
+    std::vector<std::vector<Command>> band_copies;
+    std::vector<std::vector<RawRow>> band_raw_rows;
+    std::atomic<int> bands_left{0};
+    std::promise<FrameRuns> done;
+};
+
+// 🖼️ BACKGROUND CANDIDATES - pixels covered per color, summed over the frame's runs. The
+// bands' tables are summed by sorting one (color, pixels) list - kept per worker thread, so
+// ranking a frame allocates nothing once the list has grown.
+void rank_top_colors(FrameRuns& runs) {
+    thread_local std::vector<std::pair<uint32_t, int64_t>> coverage;
+    coverage.clear();
+    for (const auto& band : runs.bands) {
+        for (const auto& [color, cmd_list] : band) {
+            int64_t pixels = 0;
+            for (const auto& cmd : cmd_list) pixels += cmd.end_x - cmd.x + 1;
+            coverage.push_back({color, pixels});
         }
     }
     
-    std::stringstream data;
-    data << "info{\nDISPLAY=" << w << "X" << h << "\nFPS=" << fps 
-         << "\nF=" << n_frames << "\nLOOP=Y\n}\n\n";
-    
-    for (const auto& [frame_range_str, color_commands] : temporal_commands) {
-        data << "F" << frame_range_str << "{\n";
-        for (const auto& [color, cmds] : color_commands) {
-            data << "  rgba(" << (int)color.r << "," << (int)color.g << "," 
-                 << (int)color.b << "," << (int)color.a << "){\n";
-            for (const auto& cmd : cmds) {
-                data << "    " << cmd << "\n";
-            }
-            data << "  }\n";
+    std::sort(coverage.begin(), coverage.end());
+    size_t colors = 0;
+    for (size_t i = 0; i < coverage.size(); i++) {
+        if (colors > 0 && coverage[colors - 1].first == coverage[i].first) {
+            coverage[colors - 1].second += coverage[i].second;
+        } else {
+            coverage[colors++] = coverage[i];
         }
-        data << "}\n";
     }
+    coverage.resize(colors);
+    
+    size_t keep = std::min(BACKGROUND_CANDIDATES, coverage.size());
+    std::partial_sort(coverage.begin(), coverage.begin() + keep, coverage.end(),
+                      [](const auto& a, const auto& b) {
+                          return a.second != b.second ? a.second > b.second : a.first < b.first;
+                      });
+    runs.top_colors.assign(coverage.begin(), coverage.begin() + keep);
+}
+
+void finish_frame_task(FrameTask& task) {
+    FrameRuns runs;
+    runs.frame_idx = task.job.frame_idx;
+    runs.w = task.job.w;
+    runs.h = task.job.h;
+    runs.bands = std::move(task.band_results);
+    runs.copies = std::move(task.band_copies);
+    runs.raw_rows = std::move(task.band_raw_rows);
+    rank_top_colors(runs);
+    
+    // Pixels are done - the slot can take a new frame while this one waits for its turn
+    if (task.job.arena) task.job.arena->release(task.job.slot);
+    task.job.owner.reset();
+    
+    task.done.set_value(std::move(runs));
+}
+
+void rle_stage(BoundedQueue<FrameJob>& decoded_frames, BoundedQueue<FrameRuns>& frame_runs,
+               WorkerPool& pool) {
+    const size_t max_in_flight = std::max(2, pool.size());
+    std::deque<std::future<FrameRuns>> in_flight;
+    
+    auto forward_oldest = [&]() {
+        frame_runs.push(in_flight.front().get());
+        in_flight.pop_front();
+        
+        processed_frames++;
+        std::cout << "✅ Frame " << processed_frames << " processed\n";
+    };
     
-    for (int frame_idx = 0; frame_idx < n_frames; frame_idx++) {
-        std::stringstream frame_data;
-        frame_data << "F" << (frame_idx + 1) << "{\n";
-        bool has_content = false;
+    FrameJob job;
+    while (decoded_frames.pop(job)) {
+        if (in_flight.size() >= max_in_flight) forward_oldest();
         
-        for (const auto& [color, cmd_list] : frame_commands[frame_idx]) {
-            bool color_written = false;
-            
-            for (const auto& cmd_data : cmd_list) {
-                if (!merged_commands[frame_idx].count(cmd_data)) {
-                    if (!color_written) {
-                        has_content = true;
-                        frame_data << "  rgba(" << (int)color.r << "," << (int)color.g << "," 
-                                   << (int)color.b << "," << (int)color.a << "){\n";
-                        color_written = true;
-                    }
-                    frame_data << "    " << cmd_data.cmd << "\n";
-                }
-            }
-            
-            if (color_written) frame_data << "  }\n";
-        }
+        int num_bands = std::max(1, (job.h + RLE_BAND_ROWS - 1) / RLE_BAND_ROWS);
+        auto task = std::make_shared<FrameTask>();
+        task->job = std::move(job);
+        task->band_results.resize(num_bands);
+        task->band_copies.resize(num_bands);
+        task->band_raw_rows.resize(num_bands);
+        task->bands_left = num_bands;
+        in_flight.push_back(task->done.get_future());
         
-        frame_data << "}\n";
-        if (has_content) data << frame_data.str();
-    }
-    
+        for (int band = 0; band < num_bands; band++) {
+            pool.submit([task, band]() {
+                const FrameJob& frame = task->job;
+                int start_row = band * RLE_BAND_ROWS;
+                int end_row = std::min(frame.h, start_row + RLE_BAND_ROWS);
+                
+                process_frame_rows_parallel(frame.pixels, frame.w, frame.h, start_row, end_row,
+                                            &task->band_results[band], &task->band_copies[band],
+                                            &task->band_raw_rows[band]);
+                
+                if (--task->bands_left == 0) finish_frame_task(*task);
+            });
+        }
+    }
+    
+    while (!in_flight.empty()) forward_oldest();
+    
+    frame_runs.close();
+}
+
+// ⏱️ TEMPORAL MERGE STAGE
+// A run stays "open" while every following frame has the exact same run. Once a frame
+// breaks the streak the run is closed and shipped as F<start>-<end> - only the previous
+// frame's runs are ever kept around!!
+// A run that left the screen less than REPEAT_WINDOW_FRAMES ago is kept dormant - if the very
+// same run comes back it continues as one command with a comma list of frame spans instead of
+// being written again. Blinking UI and looping sprites collapse into single commands!!
+const int REPEAT_WINDOW_FRAMES = 64;
+// Dormant runs kept at most, split evenly over the shards so memory doesn't grow with the
+// core count - oldest go out early past this
+const size_t DORMANT_RUN_LIMIT = 1 << 20;
+
+// Whole-clip period detection keeps the runs of the first frames around to replay them if the
+// loop breaks - capped so long non-looping clips don't pile them up
+const int PERIOD_MAX_FRAMES = 1024;
+const size_t PERIOD_MAX_RETAINED_RUNS = 1 << 22;
+
+inline uint64_t run_hash(const Command& cmd, uint32_t color) {
+    uint64_t hash = ((uint64_t)(uint32_t)cmd.y << 32 | (uint32_t)cmd.x) * 0x9E3779B97F4A7C15ull;
+    hash ^= ((uint64_t)color << 32 | (uint32_t)cmd.end_x) * 0xC2B2AE3D27D4EB4Full;
+    return hash ^ (hash >> 29);
+}
+
+struct OpenRun {
+    Command cmd;
+    uint32_t color;
+    int start;
+    bool continued;
+    int32_t history;  // earlier spans of this run (MergeShard::histories), -1 if none
+};
+
+// 🔑 OPEN RUN INDEX - (y, x, end_x, color) -> open run, one hash probe per run so the
+// whole stage is O(total runs) instead of rescanning every run of the same color
+class OpenRunIndex {
+public:
+    OpenRun* find(const Command& cmd, uint32_t color) {
+        if (slots.empty()) return nullptr;
+        int32_t idx = slots[find_slot(cmd, color)];
+        return idx < 0 ? nullptr : &runs[idx];
+    }
+    
+    void insert(const Command& cmd, uint32_t color, int start, int32_t history) {
+        if ((runs.size() + 1) * 2 > slots.size()) grow();
+        slots[find_slot(cmd, color)] = (int32_t)runs.size();
+        runs.push_back({cmd, color, start, false, history});
+    }
+    
+    // Keeps the allocations around for the next frame
+    void clear() {
+        runs.clear();
+        std::fill(slots.begin(), slots.end(), -1);
+    }
+    
+    std::vector<OpenRun>& all() { return runs; }
+    
+private:
+    size_t find_slot(const Command& cmd, uint32_t color) const {
+        size_t mask = slots.size() - 1;
+        size_t slot = run_hash(cmd, color) & mask;
+        while (slots[slot] >= 0 && !(runs[slots[slot]].cmd == cmd && runs[slots[slot]].color == color)) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+    
+    void grow() {
+        slots.assign(slots.empty() ? 1024 : slots.size() * 2, -1);
+        for (size_t i = 0; i < runs.size(); i++) {
+            slots[find_slot(runs[i].cmd, runs[i].color)] = (int32_t)i;
+        }
+    }
+    
+    std::vector<OpenRun> runs;
+    std::vector<int32_t> slots;
+};
+
+// 💤 DORMANT RUN INDEX - runs that closed recently, waiting to see if they come back.
+// Linear probing with backward-shift erase, so runs can come and go without tombstones.
+struct DormantRun {
+    Command cmd;
+    uint32_t color;
+    FrameSpan last;   // the span that just closed
+    int32_t history;  // spans before it, -1 if none
+};
+
+class DormantRunIndex {
+public:
+    DormantRun* find(const Command& cmd, uint32_t color) {
+        if (count == 0) return nullptr;
+        size_t mask = slots.size() - 1;
+        for (size_t slot = run_hash(cmd, color) & mask; used[slot]; slot = (slot + 1) & mask) {
+            if (slots[slot].cmd == cmd && slots[slot].color == color) return &slots[slot];
+        }
+        return nullptr;
+    }
+    
+    void insert(const DormantRun& run) {
+        if ((count + 1) * 2 > slots.size()) grow();
+        place(run);
+        count++;
+    }
+    
+    void erase(DormantRun* run) {
+        size_t mask = slots.size() - 1;
+        size_t hole = run - slots.data();
+        used[hole] = 0;
+        count--;
+        
+        // Pull later entries of the probe chain back into the hole
+        for (size_t slot = (hole + 1) & mask; used[slot]; slot = (slot + 1) & mask) {
+            size_t home = run_hash(slots[slot].cmd, slots[slot].color) & mask;
+            bool movable = (hole <= slot) ? (home <= hole || home > slot) : (home <= hole && home > slot);
+            if (movable) {
+                slots[hole] = slots[slot];
+                used[hole] = 1;
+                used[slot] = 0;
+                hole = slot;
+            }
+        }
+    }
+    
+    size_t size() const { return count; }
+    
+private:
+    void place(const DormantRun& run) {
+        size_t mask = slots.size() - 1;
+        size_t slot = run_hash(run.cmd, run.color) & mask;
+        while (used[slot]) slot = (slot + 1) & mask;
+        slots[slot] = run;
+        used[slot] = 1;
+    }
+    
+    void grow() {
+        std::vector<DormantRun> old_slots = std::move(slots);
+        std::vector<uint8_t> old_used = std::move(used);
+        slots.assign(old_slots.empty() ? 1024 : old_slots.size() * 2, DormantRun{});
+        used.assign(slots.size(), 0);
+        for (size_t i = 0; i < old_slots.size(); i++) {
+            if (old_used[i]) place(old_slots[i]);
+        }
+    }
+    
+    std::vector<DormantRun> slots;
+    std::vector<uint8_t> used;
+    size_t count = 0;
+};
+
+// One scanline shard of the temporal merge. Runs on different rows never interact, so
+// every shard keeps its own indexes over its own bands and shards run side by side.
+struct MergeShard {
+    int first_band, end_band;
+    size_t dormant_limit;  // this shard's share of DORMANT_RUN_LIMIT
+    OpenRunIndex open_runs, next_runs;
+    DormantRunIndex dormant_runs;
+    std::map<int, std::vector<std::pair<Command, uint32_t>>> dormant_by_end;  // expiry order
+    std::vector<std::vector<FrameSpan>> histories;
+    std::vector<int32_t> free_histories;
+    std::map<std::vector<FrameSpan>, ColorTable<Command>> closed;  // finished by the current step
+    
+    // Raw rows only merge with the very same pixels in the next frame - no dormant repeats
+    struct OpenRawRow {
+        RawRow row;
+        int start;
+        bool continued;
+    };
+    std::map<int, OpenRawRow> open_raw_rows;  // by y
+    std::map<std::vector<FrameSpan>, std::vector<RawRow>> closed_raw_rows;
+    
+    int32_t new_history() {
+        if (free_histories.empty()) {
+            histories.emplace_back();
+            return (int32_t)histories.size() - 1;
+        }
+        int32_t idx = free_histories.back();
+        free_histories.pop_back();
+        return idx;
+    }
+    
+    void free_history(int32_t idx) {
+        histories[idx].clear();
+        free_histories.push_back(idx);
+    }
+};
+
+// Runs that didn't continue into `frame` go dormant
+void close_open_runs(MergeShard& shard, int frame) {
+    for (const auto& run : shard.open_runs.all()) {
+        if (!run.continued) {
+            shard.dormant_runs.insert({run.cmd, run.color, {run.start, frame - 1}, run.history});
+            shard.dormant_by_end[frame - 1].push_back({run.cmd, run.color});
+        }
+    }
+}
+
+// Dormant runs that ended before `oldest_end` are done for good - out they go with every span
+void expire_dormant_runs(MergeShard& shard, int oldest_end) {
+    while (!shard.dormant_by_end.empty() &&
+           (shard.dormant_by_end.begin()->first < oldest_end || shard.dormant_runs.size() > shard.dormant_limit)) {
+        auto bucket = shard.dormant_by_end.begin();
+        for (const auto& [cmd, color] : bucket->second) {
+            DormantRun* run = shard.dormant_runs.find(cmd, color);
+            // Came back (and maybe left again) since then - a later bucket owns it now
+            if (!run || run->last.end != bucket->first) continue;
+            
+            std::vector<FrameSpan> spans;
+            if (run->history >= 0) {
+                spans = std::move(shard.histories[run->history]);
+                shard.free_history(run->history);
+            }
+            spans.push_back(run->last);
+            shard.closed[std::move(spans)][color].push_back(cmd);
+            shard.dormant_runs.erase(run);
+        }
+        shard.dormant_by_end.erase(bucket);
+    }
+}
+
+// Raw rows that didn't continue into `frame` are done
+void close_raw_rows(MergeShard& shard, int frame) {
+    for (auto it = shard.open_raw_rows.begin(); it != shard.open_raw_rows.end();) {
+        auto& open = it->second;
+        if (open.continued) {
+            open.continued = false;
+            ++it;
+            continue;
+        }
+        shard.closed_raw_rows[{{open.start, frame - 1}}].push_back(std::move(open.row));
+        it = shard.open_raw_rows.erase(it);
+    }
+}
+
+// Copies ride through the merge as runs of COPY_KEY_COLOR with y stored as -(y+1), so a
+// copy can never continue a real run of that color
+const uint32_t COPY_KEY_COLOR = 0;
+
+inline Command copy_key(const Command& copy) { return {copy.x, copy.end_x, -copy.y - 1}; }
+inline bool is_copy_key(const Command& cmd) { return cmd.y < 0; }
+
+void merge_shard_frame(MergeShard& shard, const FrameRuns& runs) {
+    shard.next_runs.clear();
+    int frame = runs.frame_idx;
+    
+    auto merge_run = [&](const Command& cmd_data, uint32_t color) {
+        int start = frame;
+        int32_t history = -1;
+        
+        if (OpenRun* open = shard.open_runs.find(cmd_data, color)) {
+            start = open->start;
+            history = open->history;
+            open->continued = true;
+        } else if (DormantRun* dormant = shard.dormant_runs.find(cmd_data, color)) {
+            // Back on screen - picks up where it left off
+            history = dormant->history >= 0 ? dormant->history : shard.new_history();
+            shard.histories[history].push_back(dormant->last);
+            shard.dormant_runs.erase(dormant);
+        }
+        
+        shard.next_runs.insert(cmd_data, color, start, history);
+    };
+    
+    for (int band = shard.first_band; band < shard.end_band; band++) {
+        for (const auto& [color, cmd_list] : runs.bands[band]) {
+            for (const auto& cmd_data : cmd_list) merge_run(cmd_data, color);
+        }
+        for (const auto& copy : runs.copies[band]) merge_run(copy_key(copy), COPY_KEY_COLOR);
+        
+        for (const auto& raw : runs.raw_rows[band]) {
+            auto open = shard.open_raw_rows.find(raw.y);
+            if (open != shard.open_raw_rows.end() && open->second.row == raw) {
+                open->second.continued = true;
+                continue;
+            }
+            if (open != shard.open_raw_rows.end()) {
+                shard.closed_raw_rows[{{open->second.start, frame - 1}}].push_back(std::move(open->second.row));
+            }
+            shard.open_raw_rows[raw.y] = {raw, frame, true};
+        }
+    }
+    close_raw_rows(shard, frame);
+    
+    close_open_runs(shard, frame);
+    std::swap(shard.open_runs, shard.next_runs);
+    expire_dormant_runs(shard, frame - REPEAT_WINDOW_FRAMES);
+}
+
+// Shards are combined in shard order so the output never depends on thread timing
+void ship_closed_runs(std::vector<MergeShard>& shards, BoundedQueue<TemporalBlock>& temporal_blocks) {
+    std::map<std::vector<FrameSpan>, TemporalBlock> closed;
+    
+    for (auto& shard : shards) {
+        for (auto& [spans, commands] : shard.closed) {
+            closed[spans].commands.splice(std::move(commands));
+        }
+        shard.closed.clear();
+        
+        for (auto& [spans, rows] : shard.closed_raw_rows) {
+            auto& raw_rows = closed[spans].raw_rows;
+            raw_rows.insert(raw_rows.end(), std::make_move_iterator(rows.begin()),
+                            std::make_move_iterator(rows.end()));
+        }
+        shard.closed_raw_rows.clear();
+    }
+    
+    for (auto& [spans, block] : closed) {
+        block.spans = spans;
+        temporal_blocks.push(std::move(block));
+    }
+}
+
+// Picks the frame's background and drops its runs - the sticky rule needs the previous
+// frame's pick, so this runs in frame order in the merge stage
+void strip_background(FrameRuns& runs, bool& has_previous, uint32_t& previous) {
+    if (runs.top_colors.empty()) return;
+    
+    uint32_t background = runs.top_colors[0].first;
+    if (has_previous) {
+        for (const auto& [color, pixels] : runs.top_colors) {
+            if (color == previous && pixels * BACKGROUND_STICKY_RATIO >= runs.top_colors[0].second) {
+                background = previous;
+            }
+        }
+    }
+    
+    for (auto& band : runs.bands) {
+        if (auto* cmd_list = band.find(background)) std::vector<Command>().swap(*cmd_list);
+    }
+    runs.has_background = true;
+    runs.background = background;
+    has_previous = true;
+    previous = background;
+}
+
+bool same_frame_runs(const FrameRuns& a, const FrameRuns& b) {
+    if (a.has_background != b.has_background || a.background != b.background) return false;
+    if (a.bands.size() != b.bands.size() || a.copies != b.copies || a.raw_rows != b.raw_rows) return false;
+    for (size_t band = 0; band < a.bands.size(); band++) {
+        if (a.bands[band].size() != b.bands[band].size()) return false;
+        auto other = b.bands[band].begin();
+        for (const auto& entry : a.bands[band]) {
+            if (entry.color != other->color || entry.items != other->items) return false;
+            ++other;
+        }
+    }
+    return true;
+}
+
+size_t count_runs(const FrameRuns& runs) {
+    size_t total = 0;
+    for (const auto& band : runs.bands) {
+        for (const auto& entry : band) total += entry.items.size();
+    }
+    for (const auto& band : runs.copies) total += band.size();
+    for (const auto& band : runs.raw_rows) {
+        for (const auto& raw : band) total += raw.pixels.size();
+    }
+    return total;
+}
+
+// 🔁 PERIOD DETECTOR - spots a clip that is one loop of P frames over and over (looping GIFs!!).
+// Once frame P matches frame 0, later frames are only checked against the loop and held back
+// from the merge. If the loop ever breaks, the held frames are replayed from the kept runs of
+// the first P frames and merging carries on as if nothing happened.
+class PeriodDetector {
+public:
+    int period() const { return holding ? period_frames : 0; }
+    
+    // True if the frame belongs to the loop and must not be merged. If a loop just broke,
+    // `replay` gets the frames it held (rebuilt from the kept ones) - merge those first either way.
+    bool hold(const FrameRuns& runs, std::vector<FrameRuns>& replay) {
+        int frame = runs.frame_idx;
+        
+        if (holding) {
+            if (same_frame_runs(runs, kept[frame % period_frames])) return true;
+            
+            holding = false;
+            for (int held = period_frames; held < frame; held++) {
+                replay.push_back(kept[held % period_frames]);
+                replay.back().frame_idx = held;
+            }
+            for (const auto& rebuilt : replay) keep(rebuilt);
+        }
+        
+        if (!kept.empty() && frame == (int)kept.size() && same_frame_runs(runs, kept[0])) {
+            holding = true;
+            period_frames = frame;
+            return true;
+        }
+        
+        keep(runs);
+        return false;
+    }
+    
+private:
+    // Every frame so far has to be kept for a loop to be replayable - past the caps, give up
+    void keep(const FrameRuns& runs) {
+        if (gave_up) return;
+        kept_runs += count_runs(runs);
+        if (runs.frame_idx != (int)kept.size() || kept.size() >= (size_t)PERIOD_MAX_FRAMES ||
+            kept_runs > PERIOD_MAX_RETAINED_RUNS) {
+            gave_up = true;
+            std::vector<FrameRuns>().swap(kept);
+            return;
+        }
+        kept.push_back(runs);
+    }
+    
+    std::vector<FrameRuns> kept;  // frames 0..N-1, merged and kept for replay
+    size_t kept_runs = 0;
+    int period_frames = 0;
+    bool holding = false;
+    bool gave_up = false;
+};
+
+void temporal_merge_stage(BoundedQueue<FrameRuns>& frame_runs,
+                          BoundedQueue<TemporalBlock>& temporal_blocks,
+                          WorkerPool& pool, int& period) {
+    std::vector<MergeShard> shards;
+    PeriodDetector detector;
+    int last_frame = -1;
+    bool has_background = false;
+    uint32_t background = 0;
+    
+    // Backgrounds change rarely - their frame spans are gathered here and shipped at the end
+    std::map<uint32_t, std::vector<FrameSpan>> background_spans;
+    
+    auto merge_frame = [&](const FrameRuns& runs) {
+        if (shards.empty()) {
+            int num_bands = (int)runs.bands.size();
+            int num_shards = std::max(1, std::min(pool.size(), num_bands));
+            shards.resize(num_shards);
+            for (int s = 0; s < num_shards; s++) {
+                shards[s].first_band = s * num_bands / num_shards;
+                shards[s].end_band = (s + 1) * num_bands / num_shards;
+                shards[s].dormant_limit = std::max<size_t>(1, DORMANT_RUN_LIMIT / num_shards);
+            }
+        }
+        
+        pool.parallel_for((int)shards.size(), [&](int s) {
+            merge_shard_frame(shards[s], runs);
+        });
+        
+        ship_closed_runs(shards, temporal_blocks);
+        last_frame = runs.frame_idx;
+        
+        if (runs.has_background) {
+            auto& spans = background_spans[runs.background];
+            if (!spans.empty() && spans.back().end + 1 == runs.frame_idx) spans.back().end++;
+            else spans.push_back({runs.frame_idx, runs.frame_idx});
+        }
+    };
+    
+    FrameRuns runs;
+    std::vector<FrameRuns> replay;
+    while (frame_runs.pop(runs)) {
+        strip_background(runs, has_background, background);
+        bool held_back = detector.hold(runs, replay);
+        
+        for (const auto& held : replay) merge_frame(held);
+        replay.clear();
+        if (!held_back) merge_frame(runs);
+    }
+    
+    // Whatever is still open runs through the last merged frame, and nothing comes back now
+    for (auto& shard : shards) {
+        close_open_runs(shard, last_frame + 1);
+        expire_dormant_runs(shard, INT_MAX);
+        close_raw_rows(shard, last_frame + 1);
+    }
+    ship_closed_runs(shards, temporal_blocks);
+    
+    for (auto& [color, spans] : background_spans) {
+        TemporalBlock block;
+        block.spans = std::move(spans);
+        block.is_background = true;
+        block.background = color;
+        temporal_blocks.push(std::move(block));
+    }
+    
+    period = detector.period();
+    temporal_blocks.close();
+}
+
+// 🔑 KEYFRAME + DELTA STAGE - stands in for the temporal merge in KEYFRAME mode. Every
+// KEYFRAME_INTERVAL frames the whole frame goes out, in between only the runs that aren't on
+// screen already. The player keeps the last frame it drew and paints the delta over it, so a
+// seek is the nearest keyframe plus the deltas after it - never the whole file!!
+// A frame whose delta isn't smaller than the frame itself becomes a keyframe early (scene cuts)
+const int KEYFRAME_INTERVAL = 60;
+
+// What the player will have on screen for a frame, packed - rebuilt from the runs so deltas
+// are decided pixel for pixel. `covered` is 0 where only the background fill shows.
+struct FramePixels {
+    int w = 0, h = 0;
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> covered;
+};
+
+void rasterize_frame_runs(const FrameRuns& runs, FramePixels& frame) {
+    frame.w = runs.w;
+    frame.h = runs.h;
+    uint32_t fill = runs.has_background ? runs.background : pack_rgba({0, 0, 0, 255});
+    frame.pixels.assign((size_t)runs.w * runs.h, fill);
+    frame.covered.assign((size_t)runs.w * runs.h, 0);
+    
+    auto paint = [&](int x, int end_x, int y, uint32_t packed) {
+        size_t row = (size_t)y * frame.w;
+        std::fill(frame.pixels.begin() + row + x, frame.pixels.begin() + row + end_x + 1, packed);
+        std::fill(frame.covered.begin() + row + x, frame.covered.begin() + row + end_x + 1, 1);
+    };
+    
+    std::vector<Command> copies;
+    for (size_t band = 0; band < runs.bands.size(); band++) {
+        for (const auto& [color, cmd_list] : runs.bands[band]) {
+            for (const auto& cmd : cmd_list) paint(cmd.x, cmd.end_x, cmd.y, color);
+        }
+        for (const auto& raw : runs.raw_rows[band]) {
+            size_t row = (size_t)raw.y * frame.w;
+            for (int x = raw.x; x <= raw.end_x; x++) frame.pixels[row + x] = pack_rgba(raw.pixels[x - raw.x]);
+            std::fill(frame.covered.begin() + row + raw.x, frame.covered.begin() + row + raw.end_x + 1, 1);
+        }
+        copies.insert(copies.end(), runs.copies[band].begin(), runs.copies[band].end());
+    }
+    
+    std::sort(copies.begin(), copies.end(), [](const Command& a, const Command& b) { return a.y < b.y; });
+    for (const auto& copy : copies) {
+        size_t row = (size_t)copy.y * frame.w;
+        std::copy(frame.pixels.begin() + row - frame.w + copy.x, frame.pixels.begin() + row - frame.w + copy.end_x + 1,
+                  frame.pixels.begin() + row + copy.x);
+        std::fill(frame.covered.begin() + row + copy.x, frame.covered.begin() + row + copy.end_x + 1, 1);
+    }
+}
+
+// 🏃 MOTION SEARCH - exact matches only. Every MOTION_BLOCK square of the new frame that changed
+// and isn't one flat color is hashed, then a rolling hash finds the same square anywhere in the
+// previous frame. Verified matches vote for their offset and the best voted offsets come back -
+// a scroll is one offset for the whole frame, a side-scroller with a fixed HUD still wins!!
+const int MOTION_BLOCK = 16;
+const size_t MOTION_MAX_VECTORS = 4;
+const size_t MOTION_MAX_CHECKS = 1 << 16;  // exact compares per frame - repeating textures
+// A span has to be this long to be moved instead of drawn
+const int MOTION_MIN_SPAN = 8;
+
+const uint64_t MOTION_ROW_BASE = 0x100000001B3ull;
+const uint64_t MOTION_COL_BASE = 0x9E3779B97F4A7C15ull;
+
+inline uint64_t power_of(uint64_t base, int exponent) {
+    uint64_t result = 1;
+    for (int i = 0; i < exponent; i++) result *= base;
+    return result;
+}
+
+// Hash of pixels x..x+MOTION_BLOCK-1 of every row, for every x that fits - wraps mod 2^64
+void window_row_hashes(const FramePixels& frame, std::vector<uint64_t>& hashes) {
+    int span = frame.w - MOTION_BLOCK + 1;
+    hashes.resize((size_t)std::max(span, 0) * frame.h);
+    if (span <= 0) return;
+    
+    const uint64_t top = power_of(MOTION_ROW_BASE, MOTION_BLOCK - 1);
+    for (int y = 0; y < frame.h; y++) {
+        const uint32_t* row = frame.pixels.data() + (size_t)y * frame.w;
+        uint64_t* out = hashes.data() + (size_t)y * span;
+        uint64_t hash = 0;
+        for (int i = 0; i < MOTION_BLOCK; i++) hash = hash * MOTION_ROW_BASE + row[i];
+        out[0] = hash;
+        for (int x = 1; x < span; x++) {
+            hash = (hash - row[x - 1] * top) * MOTION_ROW_BASE + row[x + MOTION_BLOCK - 1];
+            out[x] = hash;
+        }
+    }
+}
+
+bool same_block(const FramePixels& a, int ax, int ay, const FramePixels& b, int bx, int by) {
+    for (int j = 0; j < MOTION_BLOCK; j++) {
+        if (memcmp(a.pixels.data() + (size_t)(ay + j) * a.w + ax, b.pixels.data() + (size_t)(by + j) * b.w + bx,
+                   MOTION_BLOCK * sizeof(uint32_t)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::pair<int, int>> find_motion_vectors(const FramePixels& before, const std::vector<uint64_t>& before_hashes,
+                                                     const FramePixels& now, const std::vector<uint64_t>& now_hashes) {
+    std::vector<std::pair<int, int>> vectors;
+    int span = now.w - MOTION_BLOCK + 1;
+    if (span <= 0 || now.h < MOTION_BLOCK || before.w != now.w || before.h != now.h) return vectors;
+    
+    // Changed, textured blocks of the new frame by hash
+    std::unordered_map<uint64_t, std::vector<std::pair<int, int>>> blocks;
+    for (int by = 0; by + MOTION_BLOCK <= now.h; by += MOTION_BLOCK) {
+        for (int bx = 0; bx + MOTION_BLOCK <= now.w; bx += MOTION_BLOCK) {
+            if (same_block(now, bx, by, before, bx, by)) continue;
+            
+            uint32_t first = now.pixels[(size_t)by * now.w + bx];
+            bool flat = true;
+            for (int j = 0; j < MOTION_BLOCK && flat; j++) {
+                const uint32_t* row = now.pixels.data() + (size_t)(by + j) * now.w + bx;
+                flat = std::all_of(row, row + MOTION_BLOCK, [&](uint32_t p) { return p == first; });
+            }
+            if (flat) continue;
+            
+            uint64_t hash = 0;
+            for (int j = 0; j < MOTION_BLOCK; j++) hash = hash * MOTION_COL_BASE + now_hashes[(size_t)(by + j) * span + bx];
+            blocks[hash].push_back({bx, by});
+        }
+    }
+    if (blocks.empty()) return vectors;
+    
+    // Every square of the previous frame, rolled down the columns a row at a time
+    const uint64_t top = power_of(MOTION_COL_BASE, MOTION_BLOCK - 1);
+    std::vector<uint64_t> columns(span, 0);
+    for (int j = 0; j < MOTION_BLOCK; j++) {
+        for (int x = 0; x < span; x++) columns[x] = columns[x] * MOTION_COL_BASE + before_hashes[(size_t)j * span + x];
+    }
+    
+    std::map<std::pair<int, int>, int> votes;
+    size_t checks = 0;
+    for (int y = 0; y + MOTION_BLOCK <= before.h && checks < MOTION_MAX_CHECKS; y++) {
+        if (y > 0) {
+            const uint64_t* leaving = before_hashes.data() + (size_t)(y - 1) * span;
+            const uint64_t* entering = before_hashes.data() + (size_t)(y + MOTION_BLOCK - 1) * span;
+            for (int x = 0; x < span; x++) columns[x] = (columns[x] - leaving[x] * top) * MOTION_COL_BASE + entering[x];
+        }
+        for (int x = 0; x < span && checks < MOTION_MAX_CHECKS; x++) {
+            auto found = blocks.find(columns[x]);
+            if (found == blocks.end()) continue;
+            for (auto [bx, by] : found->second) {
+                if (++checks > MOTION_MAX_CHECKS) break;
+                if ((x != bx || y != by) && same_block(now, bx, by, before, x, y)) votes[{x - bx, y - by}]++;
+            }
+        }
+    }
+    
+    std::vector<std::pair<int, std::pair<int, int>>> ranked;
+    for (const auto& [vector, count] : votes) ranked.push_back({count, vector});
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    for (size_t i = 0; i < ranked.size() && i < MOTION_MAX_VECTORS; i++) vectors.push_back(ranked[i].second);
+    return vectors;
+}
+
+// Moves the spans of `now` that sit in `before` at one of `vectors` into `predicted` (a copy of
+// `before`), best vector first. A span is only moved if it fixes a pixel that is still wrong.
+void apply_motion(const FramePixels& before, const FramePixels& now, const std::vector<std::pair<int, int>>& vectors,
+                  FramePixels& predicted, std::vector<MotionRun>& moves) {
+    for (auto [dx, dy] : vectors) {
+        for (int y = std::max(0, -dy); y < now.h && y + dy < now.h; y++) {
+            const uint32_t* row = now.pixels.data() + (size_t)y * now.w;
+            const uint32_t* source = before.pixels.data() + (size_t)(y + dy) * now.w + dx;
+            uint32_t* out = predicted.pixels.data() + (size_t)y * now.w;
+            
+            int x = std::max(0, -dx), end = std::min(now.w, now.w - dx);
+            while (x < end) {
+                if (row[x] != source[x]) {
+                    x++;
+                    continue;
+                }
+                int start = x;
+                bool fixes = false;
+                for (; x < end && row[x] == source[x]; x++) fixes |= out[x] != row[x];
+                if (fixes && x - start >= MOTION_MIN_SPAN) {
+                    std::copy(source + start, source + x, out + start);
+                    moves.push_back({{start, x - 1, y}, dx, dy});
+                }
+            }
+        }
+    }
+}
+
+inline bool span_differs(const FramePixels& a, const FramePixels& b, int x, int end_x, int y) {
+    size_t row = (size_t)y * a.w;
+    return memcmp(a.pixels.data() + row + x, b.pixels.data() + row + x, (end_x - x + 1) * sizeof(uint32_t)) != 0;
+}
+
+// Everything of frame `runs` that `predicted` (the previous frame, moved) doesn't show yet:
+// its runs and copies with a wrong pixel, the wrong stretches of its raw rows, plus background
+// fill over wrong pixels only the background covers. Copies redo from the finished row above,
+// so a wrong copy is fixed too.
+// Returns the cost in runs, raw pixels counted one by one like count_runs does.
+size_t build_delta_block(const FrameRuns& runs, const FramePixels& now, const FramePixels& predicted,
+                         TemporalBlock& block) {
+    size_t cost = block.moves.size();
+    for (size_t band = 0; band < runs.bands.size(); band++) {
+        for (const auto& [color, cmd_list] : runs.bands[band]) {
+            for (const auto& cmd : cmd_list) {
+                if (!span_differs(now, predicted, cmd.x, cmd.end_x, cmd.y)) continue;
+                block.commands[color].push_back(cmd);
+                cost++;
+            }
+        }
+        // Raw rows are cut down to the stretches that differ, split where MOTION_MIN_SPAN pixels match
+        for (const auto& raw : runs.raw_rows[band]) {
+            size_t row = (size_t)raw.y * now.w;
+            for (int x = raw.x; x <= raw.end_x;) {
+                if (now.pixels[row + x] == predicted.pixels[row + x]) {
+                    x++;
+                    continue;
+                }
+                int start = x, end = x;
+                for (; x <= raw.end_x && x - end <= MOTION_MIN_SPAN; x++) {
+                    if (now.pixels[row + x] != predicted.pixels[row + x]) end = x;
+                }
+                x = end + 1;
+                block.raw_rows.push_back({start, end, raw.y, std::vector<RGBA>(raw.pixels.begin() + (start - raw.x),
+                                                                               raw.pixels.begin() + (end - raw.x + 1))});
+                cost += end - start + 1;
+            }
+        }
+        for (const auto& copy : runs.copies[band]) {
+            if (!span_differs(now, predicted, copy.x, copy.end_x, copy.y)) continue;
+            block.commands[COPY_KEY_COLOR].push_back(copy_key(copy));
+            cost++;
+        }
+    }
+    
+    uint32_t fill = runs.has_background ? runs.background : pack_rgba({0, 0, 0, 255});
+    for (int y = 0; y < now.h; y++) {
+        size_t row = (size_t)y * now.w;
+        for (int x = 0; x < now.w;) {
+            if (now.covered[row + x] || now.pixels[row + x] == predicted.pixels[row + x]) {
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < now.w && !now.covered[row + x]) x++;
+            block.commands[fill].push_back({start, x - 1, y});
+            cost++;
+        }
+    }
+    return cost;
+}
+
+void keyframe_delta_stage(BoundedQueue<FrameRuns>& frame_runs, BoundedQueue<TemporalBlock>& temporal_blocks,
+                          int& period) {
+    PeriodDetector detector;
+    bool has_background = false;
+    uint32_t background = 0;
+    
+    FramePixels previous, current, predicted;
+    std::vector<uint64_t> previous_hashes, current_hashes;
+    int previous_frame = -1;
+    int last_keyframe = -1;
+    
+    auto encode_frame = [&](FrameRuns& runs) {
+        int frame = runs.frame_idx;
+        rasterize_frame_runs(runs, current);
+        window_row_hashes(current, current_hashes);
+        
+        TemporalBlock block;
+        block.spans = {{frame, frame}};
+        bool keyframe = last_keyframe < 0 || frame - last_keyframe >= KEYFRAME_INTERVAL ||
+                        previous_frame != frame - 1 || previous.w != current.w || previous.h != current.h;
+        if (!keyframe) {
+            predicted.w = current.w;
+            predicted.h = current.h;
+            predicted.pixels = previous.pixels;
+            apply_motion(previous, current, find_motion_vectors(previous, previous_hashes, current, current_hashes),
+                         predicted, block.moves);
+            keyframe = build_delta_block(runs, current, predicted, block) >= count_runs(runs);
+        }
+        
+        if (keyframe) {
+            block = TemporalBlock();
+            block.spans = {{frame, frame}};
+            block.is_keyframe = true;
+            block.is_background = runs.has_background;
+            block.background = runs.background;
+            for (auto& band : runs.bands) block.commands.splice(std::move(band));
+            for (auto& band : runs.copies) {
+                for (const auto& copy : band) block.commands[COPY_KEY_COLOR].push_back(copy_key(copy));
+            }
+            for (auto& band : runs.raw_rows) {
+                block.raw_rows.insert(block.raw_rows.end(), std::make_move_iterator(band.begin()),
+                                      std::make_move_iterator(band.end()));
+            }
+            last_keyframe = frame;
+        }
+        temporal_blocks.push(std::move(block));
+        
+        std::swap(previous, current);
+        std::swap(previous_hashes, current_hashes);
+        previous_frame = frame;
+    };
+    
+    FrameRuns runs;
+    std::vector<FrameRuns> replay;
+    while (frame_runs.pop(runs)) {
+        strip_background(runs, has_background, background);
+        bool held_back = detector.hold(runs, replay);
+        
+        for (auto& held : replay) encode_frame(held);
+        replay.clear();
+        if (!held_back) encode_frame(runs);
+    }
+    
+    period = detector.period();
+    temporal_blocks.close();
+}
+
+// ✍️ TEXT FORMATTING - straight into a char buffer the caller made room in, std::to_chars
+// for numbers. Each returns the end of what it wrote.
+const size_t MAX_INT_CHARS = 11;
+const size_t MAX_COMMAND_CHARS = 64;
+
+inline char* put_int(char* out, int value) {
+    return std::to_chars(out, out + MAX_INT_CHARS, value).ptr;
+}
+
+template <size_t N>
+inline char* put_text(char* out, const char (&text)[N]) {
+    memcpy(out, text, N - 1);
+    return out + N - 1;
+}
+
+// 🟥 RECT COALESCING - runs of one color with the same x-span on consecutive rows become
+// one rectangle, so a solid box is one command instead of one per scanline!!
+struct CommandRect {
+    int32_t x, end_x, y, end_y;
+};
+
+void coalesce_rects(std::vector<Command>& cmds, std::vector<CommandRect>& rects) {
+    rects.clear();
+    std::sort(cmds.begin(), cmds.end(), [](const Command& a, const Command& b) {
+        if (a.x != b.x) return a.x < b.x;
+        if (a.end_x != b.end_x) return a.end_x < b.end_x;
+        return a.y < b.y;
+    });
+    for (const Command& cmd : cmds) {
+        if (!rects.empty()) {
+            CommandRect& last = rects.back();
+            if (last.x == cmd.x && last.end_x == cmd.end_x && last.end_y + 1 == cmd.y) {
+                last.end_y = cmd.y;
+                continue;
+            }
+        }
+        rects.push_back({cmd.x, cmd.end_x, cmd.y, cmd.y});
+    }
+    // back to scanline order so the text reads top to bottom like before
+    std::sort(rects.begin(), rects.end(), [](const CommandRect& a, const CommandRect& b) {
+        if (a.y != b.y) return a.y < b.y;
+        return a.x < b.x;
+    });
+}
+
+// Standard base64 with '=' padding, 4 chars per 3 bytes
+inline size_t base64_size(size_t bytes) { return (bytes + 2) / 3 * 4; }
+
+char* put_base64(char* out, const uint8_t* data, size_t size) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        uint32_t bits = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+        *out++ = digits[bits >> 18];
+        *out++ = digits[(bits >> 12) & 63];
+        *out++ = digits[(bits >> 6) & 63];
+        *out++ = digits[bits & 63];
+    }
+    if (i < size) {
+        uint32_t bits = (uint32_t)data[i] << 16 | (i + 1 < size ? (uint32_t)data[i + 1] << 8 : 0);
+        *out++ = digits[bits >> 18];
+        *out++ = digits[(bits >> 12) & 63];
+        *out++ = i + 1 < size ? digits[(bits >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+    return out;
+}
+
+// rgba(r,g,b,a) - needs 4 * MAX_INT_CHARS + 8 of room
+char* put_rgba(char* out, uint32_t packed) {
+    RGBA color = unpack_rgba(packed);
+    out = put_text(out, "rgba(");
+    out = put_int(out, color.r);
+    *out++ = ',';
+    out = put_int(out, color.g);
+    *out++ = ',';
+    out = put_int(out, color.b);
+    *out++ = ',';
+    out = put_int(out, color.a);
+    *out++ = ')';
+    return out;
+}
+
+// 📏 V2 ROW SYNTAX - every run of a block on scanline Y in one line, left to right:
+//   Y:gap,len,color[,height];gap,len,color[,height];...
+// All 0-based. gap is the distance from the end of the previous run on the line (from x=0
+// for the first), color is a palette index, height > 1 makes the run a rectangle going down.
+struct RowRun {
+    CommandRect rect;
+    int32_t color;
+};
+
+char* write_row_run(char* out, const RowRun& run, int next_x) {
+    out = put_int(out, run.rect.x - next_x);
+    *out++ = ',';
+    out = put_int(out, run.rect.end_x - run.rect.x + 1);
+    *out++ = ',';
+    out = put_int(out, run.color);
+    if (run.rect.end_y != run.rect.y) {
+        *out++ = ',';
+        out = put_int(out, run.rect.end_y - run.rect.y + 1);
+    }
+    return out;
+}
+
+// RAW=XxY-EXxY:<base64 RGBA> - pixels X..EX of row Y as they are (1-based).
+// Needs MAX_COMMAND_CHARS + base64_size(4 * pixels) of room.
+char* write_raw_row(char* out, const RawRow& raw) {
+    out = put_text(out, "    RAW=");
+    out = put_int(out, raw.x + 1);
+    *out++ = 'x';
+    out = put_int(out, raw.y + 1);
+    *out++ = '-';
+    out = put_int(out, raw.end_x + 1);
+    *out++ = 'x';
+    out = put_int(out, raw.y + 1);
+    *out++ = ':';
+    out = put_base64(out, (const uint8_t*)raw.pixels.data(), raw.pixels.size() * sizeof(RGBA));
+    *out++ = '\n';
+    return out;
+}
+
+// C=XxY-EXxEY: rows Y..EY copy columns X..EX from the row above, top row first (1-based)
+char* write_copy(char* out, const CommandRect& copy) {
+    out = put_text(out, "    C=");
+    out = put_int(out, copy.x + 1);
+    *out++ = 'x';
+    out = put_int(out, copy.y + 1);
+    *out++ = '-';
+    out = put_int(out, copy.end_x + 1);
+    *out++ = 'x';
+    out = put_int(out, copy.end_y + 1);
+    *out++ = '\n';
+    return out;
+}
+
+// P=XxY for a single pixel, PL=XxY-EXxY for a run, R=XxY-EXxEY for a filled rectangle
+// (all 1-based, inclusive). Needs MAX_COMMAND_CHARS of room.
+char* write_command(char* out, const CommandRect& cmd) {
+    if (cmd.end_y != cmd.y) {
+        out = put_text(out, "    R=");
+        out = put_int(out, cmd.x + 1);
+        *out++ = 'x';
+        out = put_int(out, cmd.y + 1);
+        *out++ = '-';
+        out = put_int(out, cmd.end_x + 1);
+        *out++ = 'x';
+        out = put_int(out, cmd.end_y + 1);
+    } else if (cmd.x == cmd.end_x) {
+        out = put_text(out, "    P=");
+        out = put_int(out, cmd.x + 1);
+        *out++ = 'x';
+        out = put_int(out, cmd.y + 1);
+    } else {
+        out = put_text(out, "    PL=");
+        out = put_int(out, cmd.x + 1);
+        *out++ = 'x';
+        out = put_int(out, cmd.y + 1);
+        *out++ = '-';
+        out = put_int(out, cmd.end_x + 1);
+        *out++ = 'x';
+        out = put_int(out, cmd.y + 1);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// 📤 OUTPUT FILE - text goes straight to disk as it's produced, through a streaming
+// multithreaded zstd context in ZSTD mode, so the full text never sits in memory!!
+// The header can't be known until the end (frame count, sizes), so a region at the front is
+// reserved and patched by finish(). Compressed, the header is its own zstd frame and the rest
+// of the region is a skippable frame - decompressed it's exactly header + body.
+const uint32_t ZSTD_SKIPPABLE_MAGIC = 0x184D2A50;
+const size_t ZSTD_SKIPPABLE_HEADER_BYTES = 8;
+const int OUTPUT_ZSTD_LEVEL = 19;
+
+class OutputFile {
+public:
+    ~OutputFile() { if (cctx) ZSTD_freeCCtx(cctx); }
+    
+    // max_header_size is the longest header finish() may get, 0 for none
+    bool open(const std::string& path, bool compress, int num_threads, size_t max_header_size) {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "❌ Failed to create " << path << "\n";
+            return false;
+        }
+        
+        if (compress) {
+            cctx = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, OUTPUT_ZSTD_LEVEL);
+            // Fails on a libzstd built without threads - it just stays single threaded then
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, num_threads);
+            out_buffer.resize(ZSTD_CStreamOutSize());
+        }
+        
+        if (max_header_size > 0) {
+            reserved = compress ? ZSTD_compressBound(max_header_size) + ZSTD_SKIPPABLE_HEADER_BYTES
+                                : max_header_size + 1;
+            std::vector<char> blank(reserved, compress ? '\0' : ' ');
+            file.write(blank.data(), reserved);
+        }
+        return true;
+    }
+    
+    void write(const char* data, size_t size) {
+        body_bytes += size;
+        if (!cctx) {
+            file.write(data, size);
+            return;
+        }
+        
+        ZSTD_inBuffer input = {data, size, 0};
+        while (input.pos < input.size && !failed) {
+            drain(input, ZSTD_e_continue);
+        }
+    }
+    
+    void write(const std::string& text) { write(text.data(), text.size()); }
+    
+    // Ends the zstd stream, fills in the header region and closes the file
+    bool finish(const std::string& header) {
+        if (cctx) {
+            ZSTD_inBuffer input = {nullptr, 0, 0};
+            while (!failed && drain(input, ZSTD_e_end) != 0) {}
+        }
+        
+        total_bytes = file.tellp();
+        
+        if (reserved > 0) {
+            std::vector<char> region(reserved, ' ');
+            if (cctx) {
+                size_t frame_size = ZSTD_compress(region.data(), reserved - ZSTD_SKIPPABLE_HEADER_BYTES,
+                                                  header.data(), header.size(), OUTPUT_ZSTD_LEVEL);
+                if (ZSTD_isError(frame_size)) {
+                    std::cerr << "❌ Header compression failed: " << ZSTD_getErrorName(frame_size) << "\n";
+                    failed = true;
+                } else {
+                    // Skippable frame = magic + payload size, both little endian
+                    uint32_t padding = reserved - frame_size - ZSTD_SKIPPABLE_HEADER_BYTES;
+                    uint8_t* skip = (uint8_t*)region.data() + frame_size;
+                    for (int i = 0; i < 4; i++) {
+                        skip[i] = (ZSTD_SKIPPABLE_MAGIC >> (8 * i)) & 0xFF;
+                        skip[4 + i] = (padding >> (8 * i)) & 0xFF;
+                    }
+                    std::fill(region.begin() + frame_size + ZSTD_SKIPPABLE_HEADER_BYTES, region.end(), '\0');
+                }
+            } else {
+                // Plain text: header, then a line of spaces the parser skips as blank
+                std::copy(header.begin(), header.end(), region.begin());
+                region.back() = '\n';
+            }
+            
+            file.seekp(0);
+            file.write(region.data(), reserved);
+        }
+        
+        file.close();
+        if (failed || file.fail()) {
+            std::cerr << "❌ Failed to write output file\n";
+            return false;
+        }
+        return true;
+    }
+    
+    uint64_t body_size() const { return body_bytes; }
+    uint64_t file_size() const { return total_bytes; }
+    
+private:
+    size_t drain(ZSTD_inBuffer& input, ZSTD_EndDirective mode) {
+        ZSTD_outBuffer output = {out_buffer.data(), out_buffer.size(), 0};
+        size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+        if (ZSTD_isError(remaining)) {
+            std::cerr << "❌ Compression failed: " << ZSTD_getErrorName(remaining) << "\n";
+            failed = true;
+            return 0;
+        }
+        file.write(out_buffer.data(), output.pos);
+        return remaining;
+    }
+    
+    std::ofstream file;
+    ZSTD_CCtx* cctx = nullptr;
+    std::vector<char> out_buffer;
+    size_t reserved = 0;
+    uint64_t body_bytes = 0;
+    uint64_t total_bytes = 0;
+    bool failed = false;
+};
+
+// 🧾 TEXT BUFFER - one flat buffer the serializer formats into, handed to the outputs in
+// OUTPUT_FLUSH_BYTES chunks. No streams, no per-frame strings, no copies of copies!!
+class TextBuffer {
+public:
+    explicit TextBuffer(std::vector<OutputFile*> outputs)
+        : outputs(std::move(outputs)), buffer(OUTPUT_FLUSH_BYTES + MAX_COMMAND_CHARS) {}
+    
+    // Room for max_bytes more - write there, then commit() the end of what was written
+    char* claim(size_t max_bytes) {
+        if (used + max_bytes > buffer.size()) flush();
+        if (max_bytes > buffer.size()) buffer.resize(max_bytes);
+        return buffer.data() + used;
+    }
+    
+    void commit(char* end) { used = end - buffer.data(); }
+    
+    void append(const char* data, size_t size) {
+        char* out = claim(size);
+        memcpy(out, data, size);
+        commit(out + size);
+    }
+    
+    bool full() const { return used >= OUTPUT_FLUSH_BYTES; }
+    
+    void flush() {
+        for (OutputFile* out : outputs) out->write(buffer.data(), used);
+        used = 0;
+    }
+    
+private:
+    std::vector<OutputFile*> outputs;
+    std::vector<char> buffer;
+    size_t used = 0;
+};
+
+// 🎨 PALETTE - shared by the text and binary serializers. A color gets the next index the
+// first time a block uses it, until PALETTE_LIMIT - colors after that stay plain RGBA.
+class Palette {
+public:
+    // Index of a color, handing out a new one on first use (`added`). -1 past PALETTE_LIMIT.
+    int32_t index_of(uint32_t packed, bool& added) {
+        added = false;
+        int32_t found = find(packed);
+        if (found >= 0) return found;
+        if (colors.size() >= PALETTE_LIMIT) return -1;
+        
+        if ((colors.size() + 1) * 2 > slots.size()) grow();
+        slots[find_slot(packed)] = (int32_t)colors.size();
+        colors.push_back(packed);
+        added = true;
+        return (int32_t)colors.size() - 1;
+    }
+    
+    int32_t index_of(uint32_t packed) {
+        bool added;
+        return index_of(packed, added);
+    }
+    
+    // Index of a color that already has one, -1 if it doesn't
+    int32_t find(uint32_t packed) const {
+        return slots.empty() ? -1 : slots[find_slot(packed)];
+    }
+    
+    size_t size() const { return colors.size(); }
+    const std::vector<uint32_t>& entries() const { return colors; }
+    
+private:
+    // Open addressing like ColorTable, but the slots hold the index itself - no list per color
+    size_t find_slot(uint32_t packed) const {
+        size_t mask = slots.size() - 1;
+        uint32_t hash = packed * 0x9E3779B1u;
+        size_t slot = (hash ^ (hash >> 16)) & mask;
+        while (slots[slot] >= 0 && colors[slots[slot]] != packed) slot = (slot + 1) & mask;
+        return slot;
+    }
+    
+    void grow() {
+        slots.assign(slots.empty() ? 16 : slots.size() * 2, -1);
+        for (size_t i = 0; i < colors.size(); i++) slots[find_slot(colors[i])] = (int32_t)i;
+    }
+    
+    std::vector<int32_t> slots;
+    std::vector<uint32_t> colors;  // by index
+};
+
+// Copies share the run table with COPY_KEY_COLOR - pulled out before the colors are written
+void split_copies(TemporalBlock& block, std::vector<Command>& copies) {
+    auto* cmds = block.commands.find(COPY_KEY_COLOR);
+    if (!cmds) return;
+    auto first_copy = std::partition(cmds->begin(), cmds->end(),
+                                     [](const Command& cmd) { return !is_copy_key(cmd); });
+    for (auto it = first_copy; it != cmds->end(); ++it) copies.push_back(copy_key(*it));
+    cmds->erase(first_copy, cmds->end());
+}
+
+// 💾 BUILD HMIC FORMAT - serialize stage, streams the body to every output as blocks arrive.
+// The header is added by OutputFile::finish() once the frame count is known.
+// 🎨 PALETTE - a color gets an index the first time a block uses it, announced in a
+// "palette{ N=rgba(...) }" section right before that block. Row lines then just say N.
+// The palette is streamed like this because the body goes out before the whole histogram is
+// known - the info{} header only gets the final PALETTE= count.
+void build_hmic_data(BoundedQueue<TemporalBlock>& temporal_blocks, std::vector<OutputFile*> outputs,
+                     int& palette_size) {
+    TextBuffer text(std::move(outputs));
+    
+    Palette palette;
+    std::vector<CommandRect> rects;
+    std::vector<RowRun> row_runs;
+    std::vector<Command> copies;
+    
+    TemporalBlock block;
+    while (temporal_blocks.pop(block)) {
+        split_copies(block, copies);
+        
+        bool palette_open = false;
+        for (const auto& [packed, cmds] : block.commands) {
+            if (cmds.empty()) continue;
+            bool added;
+            int32_t index = palette.index_of(packed, added);
+            if (!added) continue;
+            
+            if (!palette_open) {
+                text.append("palette{\n", 9);
+                palette_open = true;
+            }
+            char* out = text.claim(5 * MAX_INT_CHARS + 16);
+            out = put_text(out, "  ");
+            out = put_int(out, index);
+            *out++ = '=';
+            out = put_rgba(out, packed);
+            *out++ = '\n';
+            text.commit(out);
+        }
+        if (palette_open) text.append("}\n", 2);
+        
+        char* out = text.claim(block.spans.size() * (2 * MAX_INT_CHARS + 2) + 4);
+        *out++ = 'F';
+        for (size_t i = 0; i < block.spans.size(); i++) {
+            const FrameSpan& span = block.spans[i];
+            if (i > 0) *out++ = ',';
+            out = put_int(out, span.start + 1);
+            if (span.end != span.start) {
+                *out++ = '-';
+                out = put_int(out, span.end + 1);
+            }
+        }
+        out = put_text(out, "{\n");
+        text.commit(out);
+        
+        if (block.is_background) {
+            out = put_text(text.claim(4 * MAX_INT_CHARS + 16), "  BG=");
+            out = put_rgba(out, block.background);
+            *out++ = '\n';
+            text.commit(out);
+        }
+        
+        for (auto& [packed, cmds] : block.commands) {
+            if (cmds.empty()) continue;
+            coalesce_rects(cmds, rects);
+            
+            int32_t index = palette.find(packed);
+            if (index >= 0) {
+                for (const auto& rect : rects) row_runs.push_back({rect, index});
+                continue;
+            }
+            
+            // Past PALETTE_LIMIT - a v1 color block still does it
+            out = put_text(text.claim(4 * MAX_INT_CHARS + 16), "  ");
+            out = put_rgba(out, packed);
+            out = put_text(out, "{\n");
+            text.commit(out);
+            for (const auto& rect : rects) {
+                text.commit(write_command(text.claim(MAX_COMMAND_CHARS), rect));
+            }
+            text.append("  }\n", 4);
+        }
+        
+        std::sort(row_runs.begin(), row_runs.end(), [](const RowRun& a, const RowRun& b) {
+            return a.rect.y != b.rect.y ? a.rect.y < b.rect.y : a.rect.x < b.rect.x;
+        });
+        for (size_t i = 0; i < row_runs.size();) {
+            int y = row_runs[i].rect.y;
+            out = put_text(text.claim(MAX_INT_CHARS + 4), "  ");
+            out = put_int(out, y);
+            *out++ = ':';
+            text.commit(out);
+            
+            int next_x = 0;
+            for (bool first = true; i < row_runs.size() && row_runs[i].rect.y == y; i++, first = false) {
+                out = text.claim(MAX_COMMAND_CHARS);
+                if (!first) *out++ = ';';
+                text.commit(write_row_run(out, row_runs[i], next_x));
+                next_x = row_runs[i].rect.end_x + 1;
+            }
+            text.append("\n", 1);
+        }
+        row_runs.clear();
+        
+        if (!block.raw_rows.empty()) {
+            text.append("  raw{\n", 7);
+            for (const auto& raw : block.raw_rows) {
+                size_t max_size = MAX_COMMAND_CHARS + base64_size(raw.pixels.size() * sizeof(RGBA));
+                text.commit(write_raw_row(text.claim(max_size), raw));
+            }
+            text.append("  }\n", 4);
+        }
+        
+        if (!copies.empty()) {
+            text.append("  copy{\n", 8);
+            coalesce_rects(copies, rects);
+            for (const auto& rect : rects) {
+                text.commit(write_copy(text.claim(MAX_COMMAND_CHARS), rect));
+            }
+            text.append("  }\n", 4);
+            copies.clear();
+        }
+        text.append("}\n", 2);
+        
+        if (text.full()) text.flush();
+    }
+    
+    text.flush();
+    palette_size = (int)palette.size();
+}
+
+// v2: runs are row-grouped "Y:gap,len,color" lines instead of P=/PL=/R= under color blocks
+const int HMIC_TEXT_VERSION = 2;
+
+// period > 0: the body only holds frames 1..period, frame N shows frame ((N-1) % period) + 1
+// palette_size > 0: the body's palette{} sections define colors #0..#palette_size-1
+std::string build_hmic_header(int w, int h, int fps, int n_frames, int period, int palette_size) {
+    std::stringstream data;
+    data << "info{\nVERSION=" << HMIC_TEXT_VERSION << "\nDISPLAY=" << w << "X" << h << "\nFPS=" << fps 
+         << "\nF=" << n_frames << "\nLOOP=Y\n";
+    if (period > 0) data << "PERIOD=" << period << "\n";
+    if (palette_size > 0) data << "PALETTE=" << palette_size << "\n";
+    data << "}\n\n";
+    return data.str();
+}
+
+// Everything in a combined file before the HMIC text itself
+std::string build_hmicav_header(bool has_audio, uint64_t video_size, uint64_t audio_size) {
+    std::stringstream data;
+    data << "HMICAV_HEADER{\n";
+    data << "VERSION=1.0\n";
+    data << "HAS_VIDEO=Y\n";
+    data << "HAS_AUDIO=" << (has_audio ? "Y" : "N") << "\n";
+    data << "VIDEO_SIZE=" << video_size << "\n";
+    if (has_audio) data << "AUDIO_SIZE=" << audio_size << "\n";
+    data << "}\n\n";
+    data << "VIDEO_DATA{\n";
     return data.str();
 }
 
+// 🎯 RLE COMPRESSION FOR AUDIO - a run of 5+ samples within epsilon of its first one becomes
+// "start-end=value", anything shorter is written sample by sample, comma separated
+const float AUDIO_RLE_EPSILON = 0.00001f;
+const int AUDIO_RLE_MIN_RUN = 5;
+
+// Samples per HMICA encode task, and the longest single token one can write
+const int64_t HMICA_BLOCK_SAMPLES = 1 << 16;
+const size_t MAX_SAMPLE_TOKEN_CHARS = 96;
+
+int64_t audio_run_length(const std::vector<float>& samples, int64_t i) {
+    int64_t total = samples.size();
+    float value = samples[i];
+    int64_t run_length = 1;
+    while (i + run_length < total && std::abs(samples[i + run_length] - value) < AUDIO_RLE_EPSILON) {
+        run_length++;
+    }
+    return run_length;
+}
+
+inline char* put_sample(char* out, float value) {
+    return std::to_chars(out, out + MAX_SAMPLE_TOKEN_CHARS, value, std::chars_format::fixed, 6).ptr;
+}
+
+// Encodes samples [start, end) - start and end must sit on run boundaries
+void compress_channel_block(const std::vector<float>& samples, int64_t start, int64_t end,
+                            std::vector<char>& text) {
+    int64_t total = samples.size();
+    text.resize(std::max<size_t>(text.capacity(), (end - start) * 10 + MAX_SAMPLE_TOKEN_CHARS));
+    size_t used = 0;
+    
+    for (int64_t i = start; i < end; ) {
+        int64_t run_length = audio_run_length(samples, i);
+        
+        if (run_length >= AUDIO_RLE_MIN_RUN) {
+            if (used + MAX_SAMPLE_TOKEN_CHARS > text.size()) text.resize(text.size() * 2);
+            char* out = text.data() + used;
+            out = std::to_chars(out, out + 20, i).ptr;
+            *out++ = '-';
+            out = std::to_chars(out, out + 20, i + run_length - 1).ptr;
+            *out++ = '=';
+            out = put_sample(out, samples[i]);
+            if (i + run_length < total) *out++ = ',';
+            used = out - text.data();
+        } else {
+            for (int64_t j = 0; j < run_length; j++) {
+                if (used + MAX_SAMPLE_TOKEN_CHARS > text.size()) text.resize(text.size() * 2);
+                char* out = put_sample(text.data() + used, samples[i + j]);
+                if (i + j < total - 1) *out++ = ',';
+                used = out - text.data();
+            }
+        }
+        
+        i += run_length;
+    }
+    
+    text.resize(used);
+}
+
+// Block starts for one channel, each on a run boundary about HMICA_BLOCK_SAMPLES apart.
+// Only compares floats, so it's cheap next to the formatting the blocks do in parallel.
+std::vector<int64_t> audio_block_starts(const std::vector<float>& samples) {
+    std::vector<int64_t> starts;
+    int64_t total = samples.size();
+    int64_t next_block = 0;
+    
+    for (int64_t i = 0; i < total; ) {
+        if (i >= next_block) {
+            starts.push_back(i);
+            next_block = i + HMICA_BLOCK_SAMPLES;
+        }
+        i += audio_run_length(samples, i);
+    }
+    starts.push_back(total);
+    return starts;
+}
+
+// 🎼 LOSSLESS HMICA - exact mode, enc=LPC in the info block. Each channel is blocks of
+// LPC_BLOCK_SAMPLES predicted with the best fixed polynomial predictor (order 0-4, the
+// Shorten/FLAC set) and the residuals Rice coded. A block whose samples are all exact
+// k/2^shift fractions (16/24-bit sources) is coded as those integers, anything else as its
+// float bit patterns - either way the player gets back the very same floats!!
+//
+// Block: mode u8, shift u8, order u8, rice k u8, payload bytes u32, `order` warm-up samples
+// as i32, then the Rice bits MSB first. Everything little endian.
+const int LPC_BLOCK_SAMPLES = 4096;
+const int LPC_MAX_ORDER = 4;
+const int LPC_MAX_RICE_K = 40;
+const int RICE_ESCAPE = 32;  // this many ones = raw 64-bit value follows
+const uint8_t LPC_SCALED_INT = 0;
+const uint8_t LPC_FLOAT_BITS = 1;
+
+// Float bits -> int32 in the same order as the floats, so close samples stay close
+inline int32_t float_to_ordered(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    return (bits & 0x80000000u) ? -(int32_t)(bits & 0x7FFFFFFFu) - 1 : (int32_t)bits;
+}
+
+inline int64_t lpc_predict(const int32_t* x, int64_t i, int order) {
+    switch (order) {
+        case 0: return 0;
+        case 1: return x[i - 1];
+        case 2: return 2 * (int64_t)x[i - 1] - x[i - 2];
+        case 3: return 3 * (int64_t)x[i - 1] - 3 * (int64_t)x[i - 2] + x[i - 3];
+        default: return 4 * (int64_t)x[i - 1] - 6 * (int64_t)x[i - 2] + 4 * (int64_t)x[i - 3] - x[i - 4];
+    }
+}
+
+inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+    
+    void put(uint64_t value, int bits) {
+        if (bits > 32) {
+            put(value >> 32, bits - 32);
+            bits = 32;
+        }
+        if (bits == 0) return;
+        acc = (acc << bits) | (value & ((1ull << bits) - 1));
+        filled += bits;
+        while (filled >= 8) {
+            filled -= 8;
+            out.push_back((uint8_t)(acc >> filled));
+        }
+        acc &= (1ull << filled) - 1;
+    }
+    
+    void put_rice(uint64_t value, int k) {
+        uint64_t quotient = value >> k;
+        if (quotient < (uint64_t)RICE_ESCAPE) {
+            put(((1ull << quotient) - 1) << 1, (int)quotient + 1);
+            put(value, k);
+        } else {
+            put((1ull << RICE_ESCAPE) - 1, RICE_ESCAPE);
+            put(value, 64);
+        }
+    }
+    
+    void flush() {
+        if (filled > 0) put(0, 8 - filled);
+    }
+    
+private:
+    std::vector<uint8_t>& out;
+    uint64_t acc = 0;
+    int filled = 0;
+};
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((value >> (8 * i)) & 0xFF);
+}
+
+void encode_lpc_block(const float* samples, int count, std::vector<uint8_t>& out) {
+    out.clear();
+    std::vector<int32_t> x(count);
+    
+    // Scaled integers if every sample is an exact fraction (and no -0.0, that sign would be lost)
+    uint8_t mode = LPC_FLOAT_BITS, shift = 0;
+    for (int try_shift : {15, 23}) {
+        bool exact = true;
+        for (int i = 0; i < count && exact; i++) {
+            float scaled = std::ldexp(samples[i], try_shift);
+            exact = std::fabs(scaled) < 2147483648.0f && scaled == std::nearbyint(scaled) &&
+                    !(samples[i] == 0.0f && std::signbit(samples[i]));
+            if (exact) x[i] = (int32_t)scaled;
+        }
+        if (exact) {
+            mode = LPC_SCALED_INT;
+            shift = try_shift;
+            break;
+        }
+    }
+    if (mode == LPC_FLOAT_BITS) {
+        for (int i = 0; i < count; i++) x[i] = float_to_ordered(samples[i]);
+    }
+    
+    // Cheapest predictor by total |residual|
+    int order = 0;
+    if (count > LPC_MAX_ORDER) {
+        uint64_t cost[LPC_MAX_ORDER + 1] = {};
+        for (int i = LPC_MAX_ORDER; i < count; i++) {
+            for (int o = 0; o <= LPC_MAX_ORDER; o++) cost[o] += zigzag(x[i] - lpc_predict(x.data(), i, o));
+        }
+        for (int o = 1; o <= LPC_MAX_ORDER; o++) {
+            if (cost[o] < cost[order]) order = o;
+        }
+    }
+    
+    // Rice parameter from the mean residual
+    uint64_t sum = 0;
+    for (int i = order; i < count; i++) sum += zigzag(x[i] - lpc_predict(x.data(), i, order));
+    uint64_t n = std::max(1, count - order);
+    int k = 0;
+    while (k < LPC_MAX_RICE_K && (n << (k + 1)) <= sum) k++;
+    
+    out.push_back(mode);
+    out.push_back(shift);
+    out.push_back((uint8_t)order);
+    out.push_back((uint8_t)k);
+    size_t size_pos = out.size();
+    put_u32(out, 0);
+    for (int i = 0; i < order; i++) put_u32(out, (uint32_t)x[i]);
+    
+    size_t payload_start = out.size();
+    BitWriter bits(out);
+    for (int i = order; i < count; i++) bits.put_rice(zigzag(x[i] - lpc_predict(x.data(), i, order)), k);
+    bits.flush();
+    
+    uint32_t payload = out.size() - payload_start;
+    for (int i = 0; i < 4; i++) out[size_pos + i] = (payload >> (8 * i)) & 0xFF;
+}
+
+// 💾 BUILD HMICA FORMAT - channel blocks are encoded across the pool a wave at a time and
+// streamed to the outputs in order, so only one wave of text is in memory!!
+void build_hmica_data(const AudioData& audio, WorkerPool& pool, const std::vector<OutputFile*>& outputs,
+                      bool lossless) {
+    auto emit = [&](const char* data, size_t size) {
+        for (OutputFile* out : outputs) out->write(data, size);
+    };
+    auto emit_text = [&](const std::string& text) { emit(text.data(), text.size()); };
+    
+    emit_text("info{\nhz=" + std::to_string(audio.sample_rate) + "\nc=" + std::to_string(audio.channels) +
+              "\nsam=" + std::to_string(audio.total_samples) +
+              (lossless ? "\nenc=LPC\nblk=" + std::to_string(LPC_BLOCK_SAMPLES) : "") + "\n}\n\n");
+    
+    if (lossless) {
+        // Binary channels: byte count on its own line, then the blocks
+        for (int ch = 0; ch < audio.channels; ch++) {
+            const std::vector<float>& samples = audio.channel_data[ch];
+            int num_blocks = (int)((audio.total_samples + LPC_BLOCK_SAMPLES - 1) / LPC_BLOCK_SAMPLES);
+            std::vector<std::vector<uint8_t>> blocks(num_blocks);
+            
+            pool.parallel_for(num_blocks, [&](int b) {
+                int64_t start = (int64_t)b * LPC_BLOCK_SAMPLES;
+                int count = (int)std::min<int64_t>(LPC_BLOCK_SAMPLES, audio.total_samples - start);
+                encode_lpc_block(samples.data() + start, count, blocks[b]);
+            });
+            
+            size_t channel_bytes = 0;
+            for (const auto& block : blocks) channel_bytes += block.size();
+            
+            emit_text("C" + std::to_string(ch + 1) + "{\n" + std::to_string(channel_bytes) + "\n");
+            for (const auto& block : blocks) emit((const char*)block.data(), block.size());
+            emit_text("\n}\n");
+            if (ch < audio.channels - 1) emit_text("\n");
+        }
+        return;
+    }
+    
+    const int wave_size = std::max(2, pool.size()) * 4;
+    std::vector<std::vector<char>> block_text(wave_size);
+    
+    for (int ch = 0; ch < audio.channels; ch++) {
+        const std::vector<float>& samples = audio.channel_data[ch];
+        emit_text("C" + std::to_string(ch + 1) + "{\n");
+        
+        std::vector<int64_t> starts = audio_block_starts(samples);
+        int num_blocks = (int)starts.size() - 1;
+        
+        for (int first = 0; first < num_blocks; first += wave_size) {
+            int count = std::min(wave_size, num_blocks - first);
+            pool.parallel_for(count, [&](int b) {
+                compress_channel_block(samples, starts[first + b], starts[first + b + 1], block_text[b]);
+            });
+            for (int b = 0; b < count; b++) emit(block_text[b].data(), block_text[b].size());
+        }
+        
+        emit_text("\n}\n");
+        if (ch < audio.channels - 1) emit_text("\n");
+    }
+}
+
+// 📦 HMICB BINARY FORMAT - the temporal blocks as varint records instead of text, cut into
+// chunks that are zstd compressed when that helps, plus a per-frame list of the blocks on
+// screen. The player maps the file and draws a frame straight from its blocks - no text!!
+//
+// Layout, fixed-width fields little endian:
+//   header       HMICB_HEADER_BYTES: "HMICB\0\0\0", u32 version, width, height, fps, frames,
+//                period, palette_size, chunk_count, block_count, stored_frames, flags, then
+//                u64 index_offset, u32 index stored size, u32 index raw size
+//   chunks       block records back to back, never split across chunks
+//   index        packed like a chunk, varints: per chunk its stored and raw size (chunks
+//                follow the header in order), palette_size x RGBA, per block its record
+//                size, then per stored frame n_blocks and its block ids as deltas
+//
+// A chunk or the index whose stored size equals its raw size is not compressed.
+//
+// With HMICB_KEYFRAMES in flags, block N is stored frame N - a keyframe or a delta to paint
+// over frame N - 1. Every keyframe opens a chunk, and instead of the per-frame block lists
+// the index ends with each chunk's keyframe number as deltas. Records of such files carry
+// moves after the background: rects copied from frame N - 1 at an offset, all read from
+// frame N - 1 as it was before any of them.
+//
+// Block record, unsigned LEB128 varints (all 0-based):
+//   n_spans, per span: start - previous end - 1 (first: start), end - start
+//   has_background, [color]
+//   HMICB_KEYFRAMES only: n_moves, per move: x, y, len - 1, height - 1, zigzag dx, zigzag dy
+//   n_rows, per row: y - previous y (first: y), n_runs,
+//     per run: gap from the previous run's end, len - 1, color, height - 1
+//   n_raw, per raw row: y, x, len - 1, then len x RGBA
+//   n_copies, per copy: x, y, len - 1, height - 1
+//   color is palette index + 1, or 0 followed by RGBA for colors past PALETTE_LIMIT
+const char HMICB_MAGIC[8] = {'H', 'M', 'I', 'C', 'B', 0, 0, 0};
+// Bumped on every layout change, the player only opens its own version:
+// 1 had a 64-byte header, 2 added the keyframe layout, 3 the moves in keyframe records
+const uint32_t HMICB_VERSION = 3;
+const uint32_t HMICB_KEYFRAMES = 1;
+const size_t HMICB_HEADER_BYTES = 68;
+const size_t HMICB_CHUNK_BYTES = 1 << 20;
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out.push_back((value >> (8 * i)) & 0xFF);
+}
+
+class HmicbWriter {
+public:
+    ~HmicbWriter() { if (cctx) ZSTD_freeCCtx(cctx); }
+    
+    bool open(const std::string& path, int num_threads) {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "❌ Failed to create " << path << "\n";
+            return false;
+        }
+        
+        cctx = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, OUTPUT_ZSTD_LEVEL);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, num_threads);
+        
+        std::vector<char> blank(HMICB_HEADER_BYTES, '\0');
+        file.write(blank.data(), blank.size());
+        return true;
+    }
+    
+    // Palette index of a color, handing out a new one on first use. -1 past PALETTE_LIMIT.
+    int32_t palette_index(uint32_t packed) { return palette.index_of(packed); }
+    
+    void add_block(const std::vector<uint8_t>& record, const std::vector<FrameSpan>& spans) {
+        uint32_t block_id = (uint32_t)block_positions.size();
+        block_positions.push_back(chunk_base + chunk.size());
+        chunk.insert(chunk.end(), record.begin(), record.end());
+        
+        for (const FrameSpan& span : spans) {
+            if (span.end >= (int)frame_blocks.size()) frame_blocks.resize(span.end + 1);
+            for (int frame = span.start; frame <= span.end; frame++) frame_blocks[frame].push_back(block_id);
+        }
+        
+        if (chunk.size() >= HMICB_CHUNK_BYTES) flush_chunk();
+    }
+    
+    // KEYFRAME mode - frames come in order and only a keyframe starts a new chunk
+    void add_frame(const std::vector<uint8_t>& record, bool keyframe) {
+        if (keyframe) {
+            flush_chunk();
+            keyframes.push_back((uint32_t)block_positions.size());
+        }
+        block_positions.push_back(chunk_base + chunk.size());
+        chunk.insert(chunk.end(), record.begin(), record.end());
+    }
+    
+    bool finish(int w, int h, int fps, int n_frames, int period) {
+        flush_chunk();
+        
+        int stored_frames = period > 0 ? period : n_frames;
+        if (keyframes.empty()) frame_blocks.resize(stored_frames);
+        
+        // Varints all the way - fixed-width tables outweighed the records of a small clip
+        std::vector<uint8_t> index;
+        for (const auto& entry : chunk_table) {
+            put_varint(index, entry.stored_size);
+            put_varint(index, entry.raw_size);
+        }
+        for (uint32_t packed : palette.entries()) put_u32(index, packed);
+        for (size_t i = 0; i < block_positions.size(); i++) {
+            uint64_t next = i + 1 < block_positions.size() ? block_positions[i + 1] : chunk_base;
+            put_varint(index, next - block_positions[i]);
+        }
+        uint32_t previous = 0;
+        for (uint32_t keyframe : keyframes) {
+            put_varint(index, keyframe - previous);
+            previous = keyframe;
+        }
+        for (const auto& blocks : frame_blocks) {
+            put_varint(index, blocks.size());
+            previous = 0;
+            for (uint32_t block_id : blocks) {
+                put_varint(index, block_id - previous);
+                previous = block_id;
+            }
+        }
+        
+        uint64_t index_offset = offset;
+        uint32_t index_stored = write_packed(index);
+        total_bytes = offset;
+        
+        std::vector<uint8_t> header(HMICB_MAGIC, HMICB_MAGIC + 8);
+        for (uint32_t value : {HMICB_VERSION, (uint32_t)w, (uint32_t)h, (uint32_t)fps, (uint32_t)n_frames,
+                               (uint32_t)period, (uint32_t)palette.size(), (uint32_t)chunk_table.size(),
+                               (uint32_t)block_positions.size(), (uint32_t)stored_frames,
+                               keyframes.empty() ? 0 : HMICB_KEYFRAMES}) {
+            put_u32(header, value);
+        }
+        put_u64(header, index_offset);
+        put_u32(header, index_stored);
+        put_u32(header, (uint32_t)index.size());
+        file.seekp(0);
+        file.write((const char*)header.data(), header.size());
+        
+        file.close();
+        if (failed || file.fail()) {
+            std::cerr << "❌ Failed to write output file\n";
+            return false;
+        }
+        return true;
+    }
+    
+    int palette_size() const { return (int)palette.size(); }
+    uint64_t file_size() const { return total_bytes; }
+    
+private:
+    struct ChunkEntry {
+        uint32_t stored_size, raw_size;
+    };
+    
+    // Writes data zstd compressed, or as is when zstd doesn't win - raw rows of noise
+    // usually. Returns the stored size.
+    uint32_t write_packed(const std::vector<uint8_t>& data) {
+        std::vector<char> packed(ZSTD_compressBound(data.size()));
+        size_t size = ZSTD_compress2(cctx, packed.data(), packed.size(), data.data(), data.size());
+        if (ZSTD_isError(size)) {
+            std::cerr << "❌ Compression failed: " << ZSTD_getErrorName(size) << "\n";
+            failed = true;
+            size = data.size();
+        }
+        
+        if (size >= data.size()) {
+            size = data.size();
+            file.write((const char*)data.data(), size);
+        } else {
+            file.write(packed.data(), size);
+        }
+        offset += size;
+        return (uint32_t)size;
+    }
+    
+    void flush_chunk() {
+        if (chunk.empty()) return;
+        
+        chunk_table.push_back({write_packed(chunk), (uint32_t)chunk.size()});
+        chunk_base += chunk.size();
+        chunk.clear();
+    }
+    
+    std::ofstream file;
+    ZSTD_CCtx* cctx = nullptr;
+    std::vector<uint8_t> chunk;
+    uint64_t chunk_base = 0;  // uncompressed position of the chunk being filled
+    uint64_t offset = HMICB_HEADER_BYTES;  // file position of the next chunk
+    uint64_t total_bytes = 0;
+    std::vector<ChunkEntry> chunk_table;
+    std::vector<uint64_t> block_positions;
+    std::vector<std::vector<uint32_t>> frame_blocks;  // block ids on screen per frame
+    std::vector<uint32_t> keyframes;  // KEYFRAME mode: first frame of every chunk
+    Palette palette;
+    bool failed = false;
+};
+
+void put_hmicb_color(std::vector<uint8_t>& out, HmicbWriter& writer, uint32_t packed) {
+    int32_t index = writer.palette_index(packed);
+    if (index >= 0) {
+        put_varint(out, (uint64_t)index + 1);
+    } else {
+        put_varint(out, 0);
+        put_u32(out, packed);
+    }
+}
+
+// 💾 BUILD HMICB - the serialize stage for binary output, same blocks as build_hmic_data
+// (or the frames of the keyframe stage when `keyframes` is set)
+void build_hmicb_data(BoundedQueue<TemporalBlock>& temporal_blocks, HmicbWriter& writer, bool keyframes) {
+    std::vector<uint8_t> record;
+    std::vector<CommandRect> rects;
+    std::vector<Command> copies;
+    std::vector<std::pair<CommandRect, uint32_t>> row_runs;
+    std::map<std::pair<int32_t, int32_t>, std::vector<Command>> moves;
+    std::vector<std::pair<CommandRect, std::pair<int32_t, int32_t>>> move_rects;
+    
+    TemporalBlock block;
+    while (temporal_blocks.pop(block)) {
+        record.clear();
+        split_copies(block, copies);
+        
+        put_varint(record, block.spans.size());
+        int previous_end = -1;
+        for (const FrameSpan& span : block.spans) {
+            put_varint(record, span.start - previous_end - 1);
+            put_varint(record, span.end - span.start);
+            previous_end = span.end;
+        }
+        
+        put_varint(record, block.is_background ? 1 : 0);
+        if (block.is_background) put_hmicb_color(record, writer, block.background);
+        
+        if (keyframes) {
+            for (const auto& move : block.moves) moves[{move.dx, move.dy}].push_back(move.cmd);
+            for (auto& [vector, cmds] : moves) {
+                coalesce_rects(cmds, rects);
+                for (const auto& rect : rects) move_rects.push_back({rect, vector});
+            }
+            moves.clear();
+            
+            put_varint(record, move_rects.size());
+            for (const auto& [rect, vector] : move_rects) {
+                put_varint(record, rect.x);
+                put_varint(record, rect.y);
+                put_varint(record, rect.end_x - rect.x);
+                put_varint(record, rect.end_y - rect.y);
+                put_varint(record, zigzag(vector.first));
+                put_varint(record, zigzag(vector.second));
+            }
+            move_rects.clear();
+        }
+        
+        for (auto& [packed, cmds] : block.commands) {
+            if (cmds.empty()) continue;
+            coalesce_rects(cmds, rects);
+            for (const auto& rect : rects) row_runs.push_back({rect, packed});
+        }
+        std::sort(row_runs.begin(), row_runs.end(), [](const auto& a, const auto& b) {
+            return a.first.y != b.first.y ? a.first.y < b.first.y : a.first.x < b.first.x;
+        });
+        
+        size_t n_rows = 0;
+        for (size_t i = 0; i < row_runs.size(); i++) {
+            if (i == 0 || row_runs[i].first.y != row_runs[i - 1].first.y) n_rows++;
+        }
+        put_varint(record, n_rows);
+        int previous_y = 0;
+        for (size_t i = 0; i < row_runs.size();) {
+            int y = row_runs[i].first.y;
+            size_t row_end = i;
+            while (row_end < row_runs.size() && row_runs[row_end].first.y == y) row_end++;
+            
+            put_varint(record, y - previous_y);
+            put_varint(record, row_end - i);
+            int next_x = 0;
+            for (; i < row_end; i++) {
+                const auto& [rect, packed] = row_runs[i];
+                put_varint(record, rect.x - next_x);
+                put_varint(record, rect.end_x - rect.x);
+                put_hmicb_color(record, writer, packed);
+                put_varint(record, rect.end_y - rect.y);
+                next_x = rect.end_x + 1;
+            }
+            previous_y = y;
+        }
+        row_runs.clear();
+        
+        put_varint(record, block.raw_rows.size());
+        for (const auto& raw : block.raw_rows) {
+            put_varint(record, raw.y);
+            put_varint(record, raw.x);
+            put_varint(record, raw.end_x - raw.x);
+            const uint8_t* pixels = (const uint8_t*)raw.pixels.data();
+            record.insert(record.end(), pixels, pixels + raw.pixels.size() * sizeof(RGBA));
+        }
+        
+        coalesce_rects(copies, rects);
+        copies.clear();
+        put_varint(record, rects.size());
+        for (const auto& copy : rects) {
+            put_varint(record, copy.x);
+            put_varint(record, copy.y);
+            put_varint(record, copy.end_x - copy.x);
+            put_varint(record, copy.end_y - copy.y);
+        }
+        
+        if (keyframes) writer.add_frame(record, block.is_keyframe);
+        else writer.add_block(record, block.spans);
+    }
+}
+
+// 📦 SECTIONED HMICAV7 - a plain header with byte offsets, then the .hmic7 and .hmica7 files
+// copied in as they are. Nothing gets compressed twice and players can unpack both at once!!
+std::string build_hmicav_section_header(bool has_audio, uint64_t video_size, uint64_t audio_size) {
+    // The offsets count the header itself - rebuild until its length stops changing
+    std::string header;
+    size_t header_size;
+    do {
+        header_size = header.size();
+        std::stringstream data;
+        data << "HMICAV_HEADER{\n";
+        data << "VERSION=2.0\n";
+        data << "HAS_VIDEO=Y\n";
+        data << "HAS_AUDIO=" << (has_audio ? "Y" : "N") << "\n";
+        data << "VIDEO_OFFSET=" << header_size << "\n";
+        data << "VIDEO_SIZE=" << video_size << "\n";
+        if (has_audio) {
+            data << "AUDIO_OFFSET=" << (header_size + video_size) << "\n";
+            data << "AUDIO_SIZE=" << audio_size << "\n";
+        }
+        data << "}\n";
+        header = data.str();
+    } while (header.size() != header_size);
+    
+    return header;
+}
+
+bool write_hmicav_sections(const std::string& path, const std::string& video_file,
+                           const std::string& audio_file, bool has_audio) {
+    uint64_t video_size = fs::file_size(video_file);
+    uint64_t audio_size = has_audio ? fs::file_size(audio_file) : 0;
+    
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "❌ Failed to create " << path << "\n";
+        return false;
+    }
+    
+    out << build_hmicav_section_header(has_audio, video_size, audio_size);
+    
+    std::ifstream video(video_file, std::ios::binary);
+    out << video.rdbuf();
+    if (has_audio) {
+        std::ifstream audio(audio_file, std::ios::binary);
+        out << audio.rdbuf();
+    }
+    
+    out.close();
+    if (out.fail()) {
+        std::cerr << "❌ Failed to write " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
 int main() {
     mpg123_init();
     
@@ -652,196 +3190,189 @@ int main() {
                      ext == "mkv" || ext == "flv" || ext == "wmv" || ext == "m4v");
     bool is_gif = (ext == "gif");
     
-    int w, h, n_frames = 1, fps = 1;
-    std::vector<std::vector<RGBA>> frames_data;
+    // Get output format - asked up front since frames are encoded while they decode!!
+    std::string mode;
+    std::cout << "\nChoose compression (NONE / ZSTD / BINARY / KEYFRAME): ";
+    std::getline(std::cin, mode);
+    std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+    // BINARY writes the video as .hmicb - audio goes next to it as .hmica7, no combined file.
+    // KEYFRAME is the same file as keyframes + deltas, seekable without the whole file.
+    bool keyframes = (mode == "KEYFRAME");
+    bool binary = (mode == "BINARY") || keyframes;
+    bool compress = (mode == "ZSTD") || binary;
+    
+    // Audio only comes out of videos
+    bool lossless_audio = false;
+    if (is_video) {
+        std::string audio_mode;
+        std::cout << "Audio encoding (TEXT / LOSSLESS): ";
+        std::getline(std::cin, audio_mode);
+        std::transform(audio_mode.begin(), audio_mode.end(), audio_mode.begin(), ::toupper);
+        lossless_audio = (audio_mode == "LOSSLESS");
+    }
+    
+    int w = 0, h = 0, n_frames = 0, fps = 1;
     AudioData audio;
     bool has_audio = false;
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());  // 0 when unknown
+    
+    std::string base_name = fs::path(media_path).stem().string();
+    std::string hmic_file = base_name + (binary ? ".hmicb" : compress ? ".hmic7" : ".hmic");
+    std::string hmica_file = base_name + (compress ? ".hmica7" : ".hmica");
+    std::string combined_file = base_name + (compress ? ".hmicav7" : ".hmicav");
+    
+    // 🚀 OUTPUT FILES - opened now so the serializer streams straight into them. Headers get
+    // room for the biggest values they could ever hold and are filled in at the end.
+    size_t max_hmic_header = build_hmic_header(INT_MAX, INT_MAX, INT_MAX, INT_MAX, INT_MAX, INT_MAX).size();
+    size_t max_combined_header = build_hmicav_header(true, UINT64_MAX, UINT64_MAX).size() + max_hmic_header;
+    
+    // ZSTD mode builds the combined file from the finished sections, plain text streams it too
+    OutputFile hmic_out, combined_out;
+    HmicbWriter hmicb_out;
+    std::vector<OutputFile*> text_outputs = {&hmic_out};
+    if (!compress) text_outputs.push_back(&combined_out);
+    
+    if (binary ? !hmicb_out.open(hmic_file, num_threads)
+               : (!hmic_out.open(hmic_file, compress, num_threads, max_hmic_header) ||
+                  (!compress && !combined_out.open(combined_file, false, num_threads, max_combined_header)))) {
+        mpg123_exit();
+        return 1;
+    }
+    
+    // 🏭 STREAMING PIPELINE: decode -> RLE -> temporal merge -> serialize
+    // All stages run at once and hand work over through bounded queues, so only a
+    // handful of decoded frames are alive at any time no matter how long the input is!!
+    std::cout << "\n🎨 Streaming frames through the pipeline with " << num_threads << " threads...\n";
+    
+    BoundedQueue<FrameJob> decoded_frames(PIPELINE_QUEUE_DEPTH);
+    BoundedQueue<FrameRuns> frame_runs(PIPELINE_QUEUE_DEPTH);
+    BoundedQueue<TemporalBlock> temporal_blocks(PIPELINE_BLOCK_QUEUE_DEPTH);
+    
+    WorkerPool pool(num_threads);
+    std::thread rle_thread(rle_stage, std::ref(decoded_frames), std::ref(frame_runs), std::ref(pool));
+    int period = 0;
+    std::thread merge_thread = keyframes
+        ? std::thread(keyframe_delta_stage, std::ref(frame_runs), std::ref(temporal_blocks), std::ref(period))
+        : std::thread(temporal_merge_stage, std::ref(frame_runs), std::ref(temporal_blocks),
+                      std::ref(pool), std::ref(period));
+    int palette_size = 0;
+    std::thread serialize_thread = binary
+        ? std::thread(build_hmicb_data, std::ref(temporal_blocks), std::ref(hmicb_out), keyframes)
+        : std::thread(build_hmic_data, std::ref(temporal_blocks), text_outputs, std::ref(palette_size));
+    
+    // Enough arena slots for a full decode queue, every RLE frame in flight, the frame
+    // being decoded and the one the RLE stage is holding
+    int arena_slots = (int)PIPELINE_QUEUE_DEPTH + std::max(2, num_threads) + 2;
+    FrameSink frames(decoded_frames, arena_slots);
+    
+    bool loaded = false;
     
     if (is_video) {
         std::cout << "\n🎬 VIDEO MODE!! Extracting frames + audio...\n";
         VideoInfo info;
         
-        if (!extract_video_frames(media_path, info, frames_data, &audio)) {
-            mpg123_exit();
-            return 1;
+        loaded = extract_video_frames(media_path, info, frames, &audio);
+        if (loaded) {
+            w = info.width;
+            h = info.height;
+            fps = info.fps_num / info.fps_den;
+            has_audio = info.has_audio && audio.total_samples > 0;
         }
         
-        w = info.width;
-        h = info.height;
-        n_frames = frames_data.size();
-        fps = info.fps_num / info.fps_den;
-        has_audio = info.has_audio && audio.total_samples > 0;
-        
     } else if (is_gif) {
         std::cout << "\n🎬 GIF MODE!! Extracting animated frames...\n";
         
-        if (!load_gif_frames(media_path, w, h, n_frames, fps, frames_data)) {
-            mpg123_exit();
-            return 1;
+        loaded = load_gif_frames(media_path, w, h, n_frames, fps, frames);
+        if (loaded) {
+            std::cout << "✅ GIF loaded: " << n_frames << " frames @ " << fps << " FPS\n";
         }
         
-        std::cout << "✅ GIF loaded: " << n_frames << " frames @ " << fps << " FPS\n";
-        
     } else {
         std::cout << "\n📸 STATIC IMAGE MODE!!\n";
         
-        std::vector<RGBA> pixels;
-        if (!load_universal_image(media_path, w, h, pixels)) {
-            mpg123_exit();
-            return 1;
+        loaded = load_universal_image(media_path, w, h, frames);
+        if (loaded) {
+            std::cout << "✅ Image loaded: " << w << "x" << h << "\n";
         }
-        
-        frames_data.push_back(pixels);
-        std::cout << "✅ Image loaded: " << w << "x" << h << "\n";
     }
     
-    // Get output format
-    std::string mode;
-    std::cout << "\nChoose compression (NONE / ZSTD): ";
-    std::getline(std::cin, mode);
-    std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
-    bool compress = (mode == "ZSTD");
-    
-    // 🧠 PROCESS ALL FRAMES
-    std::cout << "\n🎨 Processing " << n_frames << " frames with " 
-              << std::thread::hardware_concurrency() << " threads...\n";
+    // No more frames coming - let every stage drain
+    decoded_frames.close();
+    rle_thread.join();
+    merge_thread.join();
+    serialize_thread.join();
+    
+    if (!loaded) {
+        if (binary) hmicb_out.finish(0, 0, 0, 0, 0);
+        else for (OutputFile* out : text_outputs) out->finish("");
+        fs::remove(hmic_file);
+        if (!compress) fs::remove(combined_file);
+        mpg123_exit();
+        return 1;
+    }
     
-    std::vector<std::map<RGBA, std::vector<Command>>> frame_commands(n_frames);
-    int num_threads = std::thread::hardware_concurrency();
+    n_frames = frames.frame_count();
     
-    for (int frame_idx = 0; frame_idx < n_frames; frame_idx++) {
-        processed_rows = 0;
-        
-        int rows_per_chunk = std::max(1, h / num_threads);
-        std::vector<std::thread> threads;
-        std::vector<std::map<RGBA, std::vector<Command>>> thread_results(num_threads);
-        
-        for (int t = 0; t < num_threads; t++) {
-            int start_row = t * rows_per_chunk;
-            int end_row = (t == num_threads - 1) ? h : (t + 1) * rows_per_chunk;
-            
-            threads.emplace_back(process_frame_rows_parallel,
-                               std::ref(frames_data[frame_idx]), w, h,
-                               start_row, end_row, &thread_results[t]);
-        }
-        
-        for (auto& t : threads) t.join();
-        
-        // Merge results
-        for (const auto& result : thread_results) {
-            for (const auto& [color, cmds] : result) {
-                frame_commands[frame_idx][color].insert(
-                    frame_commands[frame_idx][color].end(),
-                    cmds.begin(), cmds.end()
-                );
-            }
-        }
-        
-        processed_frames++;
-        std::cout << "✅ Frame " << processed_frames << "/" << n_frames << " processed\n";
+    // 💾 FINISH HMIC DATA
+    std::cout << "\n📝 Finishing HMIC visual data...\n";
+    if (period > 0) {
+        std::cout << "🔁 Clip loops every " << period << " frames - only one loop stored!!\n";
     }
+    std::string hmic_header = build_hmic_header(w, h, fps, n_frames, period, palette_size);
+    uint64_t hmic_size = hmic_header.size() + hmic_out.body_size();
     
-    // 💾 BUILD HMIC DATA
-    std::cout << "\n📝 Building HMIC visual data...\n";
-    std::string hmic_text = build_hmic_data(w, h, fps, n_frames, frame_commands);
-    
-    std::string base_name = fs::path(media_path).stem().string();
+    if (binary ? !hmicb_out.finish(w, h, fps, n_frames, period) : !hmic_out.finish(hmic_header)) {
+        mpg123_exit();
+        return 1;
+    }
+    uint64_t hmic_file_size = binary ? hmicb_out.file_size() : hmic_out.file_size();
+    std::cout << "✅ " << hmic_file << " created (" << (hmic_file_size / 1024.0) << " KB)\n";
     
     // 🎵 BUILD HMICA DATA IF AUDIO EXISTS
-    std::string hmica_text;
+    // Plain text mode streams it into the combined file's audio section at the same time
+    if (!compress) combined_out.write("\n}\n");
+    
+    uint64_t hmica_size = 0;
+    // The player plays a .hmicb with the .hmica7 next to it - don't leave an old one behind
+    if (binary && !has_audio) fs::remove(hmica_file);
     if (has_audio) {
         std::cout << "📝 Building HMICA audio data...\n";
-        hmica_text = build_hmica_data(audio);
-    }
-    
-    // 🚀 WRITE OUTPUT FILES
-    std::cout << "\n💾 Writing output files...\n";
-    
-    std::string hmic_file = base_name + (compress ? ".hmic7" : ".hmic");
-    std::string hmica_file = base_name + (compress ? ".hmica7" : ".hmica");
-    std::string combined_file = base_name + (compress ? ".hmicav7" : ".hmicav");
-    
-    if (compress) {
-        // Compress HMIC
-        size_t hmic_bound = ZSTD_compressBound(hmic_text.size());
-        std::vector<char> hmic_compressed(hmic_bound);
-        size_t hmic_size = ZSTD_compress(hmic_compressed.data(), hmic_bound,
-                                         hmic_text.c_str(), hmic_text.size(), 19);
         
-        if (!ZSTD_isError(hmic_size)) {
-            std::ofstream file(hmic_file, std::ios::binary);
-            file.write(hmic_compressed.data(), hmic_size);
-            file.close();
-            std::cout << "✅ " << hmic_file << " created (" << (hmic_size / 1024.0) << " KB)\n";
+        OutputFile hmica_out;
+        if (!hmica_out.open(hmica_file, compress, num_threads, 0)) {
+            mpg123_exit();
+            return 1;
         }
         
-        // Compress HMICA if exists
-        if (has_audio) {
-            size_t hmica_bound = ZSTD_compressBound(hmica_text.size());
-            std::vector<char> hmica_compressed(hmica_bound);
-            size_t hmica_size = ZSTD_compress(hmica_compressed.data(), hmica_bound,
-                                             hmica_text.c_str(), hmica_text.size(), 19);
-            
-            if (!ZSTD_isError(hmica_size)) {
-                std::ofstream file(hmica_file, std::ios::binary);
-                file.write(hmica_compressed.data(), hmica_size);
-                file.close();
-                std::cout << "✅ " << hmica_file << " created (" << (hmica_size / 1024.0) << " KB)\n";
-            }
-        }
-        
-        // Create combined format
-        std::stringstream combined;
-        combined << "HMICAV_HEADER{\n";
-        combined << "VERSION=1.0\n";
-        combined << "HAS_VIDEO=Y\n";
-        combined << "HAS_AUDIO=" << (has_audio ? "Y" : "N") << "\n";
-        combined << "VIDEO_SIZE=" << hmic_text.size() << "\n";
-        if (has_audio) combined << "AUDIO_SIZE=" << hmica_text.size() << "\n";
-        combined << "}\n\n";
-        combined << "VIDEO_DATA{\n" << hmic_text << "\n}\n";
-        if (has_audio) combined << "\nAUDIO_DATA{\n" << hmica_text << "\n}\n";
-        
-        std::string combined_text = combined.str();
-        size_t combined_bound = ZSTD_compressBound(combined_text.size());
-        std::vector<char> combined_compressed(combined_bound);
-        size_t combined_size = ZSTD_compress(combined_compressed.data(), combined_bound,
-                                             combined_text.c_str(), combined_text.size(), 19);
-        
-        if (!ZSTD_isError(combined_size)) {
-            std::ofstream file(combined_file, std::ios::binary);
-            file.write(combined_compressed.data(), combined_size);
-            file.close();
-            std::cout << "✅ " << combined_file << " created (" << (combined_size / 1024.0) << " KB)\n";
+        std::vector<OutputFile*> audio_outputs = {&hmica_out};
+        if (!compress) {
+            combined_out.write("\nAUDIO_DATA{\n");
+            audio_outputs.push_back(&combined_out);
         }
+        build_hmica_data(audio, pool, audio_outputs, lossless_audio);
+        if (!compress) combined_out.write("\n}\n");
         
-    } else {
-        // Write uncompressed
-        std::ofstream hmic_out(hmic_file);
-        hmic_out << hmic_text;
-        hmic_out.close();
-        std::cout << "✅ " << hmic_file << " created (" << (hmic_text.size() / 1024.0) << " KB)\n";
-        
-        if (has_audio) {
-            std::ofstream hmica_out(hmica_file);
-            hmica_out << hmica_text;
-            hmica_out.close();
-            std::cout << "✅ " << hmica_file << " created (" << (hmica_text.size() / 1024.0) << " KB)\n";
-        }
-        
-        // Create combined format
-        std::ofstream combined_out(combined_file);
-        combined_out << "HMICAV_HEADER{\n";
-        combined_out << "VERSION=1.0\n";
-        combined_out << "HAS_VIDEO=Y\n";
-        combined_out << "HAS_AUDIO=" << (has_audio ? "Y" : "N") << "\n";
-        combined_out << "VIDEO_SIZE=" << hmic_text.size() << "\n";
-        if (has_audio) combined_out << "AUDIO_SIZE=" << hmica_text.size() << "\n";
-        combined_out << "}\n\n";
-        combined_out << "VIDEO_DATA{\n" << hmic_text << "\n}\n";
-        if (has_audio) combined_out << "\nAUDIO_DATA{\n" << hmica_text << "\n}\n";
-        combined_out.close();
-        std::cout << "✅ " << combined_file << " created\n";
+        hmica_size = hmica_out.body_size();
+        if (!hmica_out.finish("")) {
+            mpg123_exit();
+            return 1;
+        }
+        std::cout << "✅ " << hmica_file << " created (" << (hmica_out.file_size() / 1024.0) << " KB)\n";
+    }
+    
+    if (compress && !binary) {
+        // Already compressed sections, copied in behind an offset header
+        if (!write_hmicav_sections(combined_file, hmic_file, hmica_file, has_audio)) {
+            mpg123_exit();
+            return 1;
+        }
+        std::cout << "✅ " << combined_file << " created (" << (fs::file_size(combined_file) / 1024.0) << " KB)\n";
+    } else if (!compress) {
+        if (!combined_out.finish(build_hmicav_header(has_audio, hmic_size, hmica_size) + hmic_header)) {
+            mpg123_exit();
+            return 1;
+        }
+        std::cout << "✅ " << combined_file << " created (" << (combined_out.file_size() / 1024.0) << " KB)\n";
     }
     
     // 📊 FINAL STATS
@@ -853,17 +3384,23 @@ int main() {
         std::cout << "🎵 Audio: " << audio.sample_rate << "Hz, " << audio.channels 
                   << " channels, " << audio.total_samples << " samples\n";
         std::cout << "⏱️  Audio duration: " << (float)audio.total_samples / audio.sample_rate << "s\n";
+        std::cout << "🎼 Audio encoding: " << (lossless_audio ? "Lossless LPC + Rice" : "Text") << "\n";
     } else {
         std::cout << "🎵 Audio: None\n";
     }
-    std::cout << "💾 Compression: " << (compress ? "Zstd level 19" : "None") << "\n";
+    std::cout << "💾 Compression: " << (keyframes ? "HMICB keyframes + deltas, zstd chunks"
+                                       : binary ? "HMICB varint records, zstd chunks"
+                                       : compress ? "Zstd level 19, streaming" : "None") << "\n";
     std::cout << "🧵 Threads used: " << num_threads << "\n";
     
     std::cout << "\n💥 CONVERSION COMPLETE!! 💥\n";
     std::cout << "📦 Files created:\n";
     std::cout << "   - " << hmic_file << " (visual data)\n";
-    if (has_audio) std::cout << "   - " << hmica_file << " (audio data)\n";
-    std::cout << "   - " << combined_file << " (combined format)\n";
+    if (has_audio) {
+        std::cout << "   - " << hmica_file << " (audio data"
+                  << (binary ? ", keep it next to " + hmic_file : "") << ")\n";
+    }
+    if (!binary) std::cout << "   - " << combined_file << " (combined format)\n";
     std::cout << "\n🔥 THE FUTURE OF MEDIA IS HERE!! 🔥\n";
     std::cout << "✨ FULL RGBA + TEMPORAL COMPRESSION + MULTI-THREADED ✨\n";
     
@@ -11,6 +11,15 @@
 #include <chrono>
 #include <cmath>
 #include <queue>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <memory>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // 🎮 SDL2 FOR RENDERING + AUDIO
 #include <SDL2/SDL.h>
@@ -24,9 +33,30 @@ struct RGBA {
 };
 
 // 🎬 FRAME DATA
+// C= span - rows y1..y2 copy columns x1..x2 from the row above, 0-based
+struct RowCopy {
+    int x1, y1, x2, y2;
+};
+
+// v2 "gap,len,color[,height]" run - already resolved to a position and a color
+struct SpanRun {
+    int x, y, len, height;
+    RGBA color;
+};
+
+// RAW= span - pixels x1..x2 of row y, shared by every frame of its block
+struct RawRow {
+    int x1, x2, y;
+    std::shared_ptr<const std::vector<RGBA>> pixels;
+};
+
 struct Frame {
     int frame_number;
-    std::map<RGBA, std::vector<std::string>> commands;
+    RGBA background = {0, 0, 0, 255};  // BG= fill, black if the file has none
+    std::map<RGBA, std::vector<std::string>> commands;  // v1 P=/PL=/R= lines
+    std::vector<SpanRun> runs;  // v2 row lines, sorted top to bottom, left to right
+    std::vector<RawRow> raw_rows;  // drawn after the colors, before the copies
+    std::vector<RowCopy> copies;  // run after all colors, top row first
 };
 
 // 🎵 AUDIO DATA
@@ -43,6 +73,7 @@ struct VideoInfo {
     int fps;
     int total_frames;
     bool loop;
+    int period = 0;  // PERIOD=P: only frames 1..P are stored, the clip repeats them
 };
 
 // 🎮 PLAYER STATE - FIXED FOR SYNC!!
@@ -75,28 +106,85 @@ bool operator<(const RGBA& a, const RGBA& b) {
     return a.a < b.a;
 }
 
-// 🔥 DECOMPRESS ZSTD
-std::string decompress_zstd(const std::vector<char>& compressed) {
-    size_t decompressed_size = ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+// 🔥 DECOMPRESS ZSTD - streaming, so it takes multi-frame files (header frame + skippable
+// padding + body) and bodies written without a content size
+std::string decompress_zstd(const char* compressed, size_t compressed_size) {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    std::vector<char> chunk(ZSTD_DStreamOutSize());
+    std::string decompressed;
+    decompressed.reserve(compressed_size * 4);
     
-    if (decompressed_size == ZSTD_CONTENTSIZE_ERROR || 
-        decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN) {
-        std::cerr << "❌ Cannot determine decompressed size\n";
-        return "";
+    ZSTD_inBuffer input = {compressed, compressed_size, 0};
+    size_t result = 0;
+    while (input.pos < input.size) {
+        ZSTD_outBuffer output = {chunk.data(), chunk.size(), 0};
+        result = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(result)) {
+            std::cerr << "❌ Decompression error: " << ZSTD_getErrorName(result) << "\n";
+            ZSTD_freeDCtx(dctx);
+            return "";
+        }
+        decompressed.append(chunk.data(), output.pos);
     }
     
-    std::string decompressed(decompressed_size, '\0');
-    size_t result = ZSTD_decompress(&decompressed[0], decompressed_size,
-                                    compressed.data(), compressed.size());
-    
-    if (ZSTD_isError(result)) {
-        std::cerr << "❌ Decompression error: " << ZSTD_getErrorName(result) << "\n";
-        return "";
+    // Input used up but the decoder still holds data - keep flushing
+    while (result != 0) {
+        ZSTD_outBuffer output = {chunk.data(), chunk.size(), 0};
+        result = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(result) || output.pos == 0) {
+            std::cerr << "❌ Truncated Zstd data\n";
+            ZSTD_freeDCtx(dctx);
+            return "";
+        }
+        decompressed.append(chunk.data(), output.pos);
     }
     
+    ZSTD_freeDCtx(dctx);
     return decompressed;
 }
 
+// 📦 SECTIONED HMICAV7 - plain header with byte offsets, then the video and audio sections
+// each compressed on their own
+struct HmicavSections {
+    bool has_audio = false;
+    size_t video_offset = 0, video_size = 0;
+    size_t audio_offset = 0, audio_size = 0;
+};
+
+bool parse_section_header(const std::vector<char>& buffer, HmicavSections& sections) {
+    const char magic[] = "HMICAV_HEADER{\n";
+    if (buffer.size() < sizeof(magic) - 1 || memcmp(buffer.data(), magic, sizeof(magic) - 1) != 0) {
+        return false;
+    }
+    
+    // Old combined files are plain text all the way - only v2 headers carry offsets
+    std::string header(buffer.data(), std::min<size_t>(buffer.size(), 1024));
+    size_t end = header.find("\n}\n");
+    if (end == std::string::npos || header.find("VIDEO_OFFSET=") == std::string::npos) return false;
+    
+    std::stringstream ss(header.substr(0, end));
+    std::string line;
+    while (std::getline(ss, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        
+        if (key == "HAS_AUDIO") sections.has_audio = (value == "Y");
+        else if (key == "VIDEO_OFFSET") sections.video_offset = std::stoull(value);
+        else if (key == "VIDEO_SIZE") sections.video_size = std::stoull(value);
+        else if (key == "AUDIO_OFFSET") sections.audio_offset = std::stoull(value);
+        else if (key == "AUDIO_SIZE") sections.audio_size = std::stoull(value);
+    }
+    
+    if (sections.video_offset + sections.video_size > buffer.size() ||
+        (sections.has_audio && sections.audio_offset + sections.audio_size > buffer.size())) {
+        std::cerr << "❌ HMICAV sections run past the end of the file\n";
+        return false;
+    }
+    return true;
+}
+
 // 📖 PARSE RGBA COLOR
 RGBA parse_rgba(const std::string& color_str) {
     RGBA color = {0, 0, 0, 255};
@@ -175,19 +263,205 @@ bool parse_audio_channel(const std::string& data, std::vector<float>& samples) {
     return true;
 }
 
+// 🎼 LOSSLESS HMICA (enc=LPC) - blocks of fixed-polynomial prediction + Rice coded residuals.
+// Block: mode u8, shift u8, order u8, rice k u8, payload bytes u32, `order` warm-up i32s,
+// then the Rice bits MSB first. Mode 0 = samples are ints / 2^shift, 1 = ordered float bits.
+const int RICE_ESCAPE = 32;
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+    
+    uint64_t get(int bits) {
+        uint64_t value = 0;
+        while (bits > 0) {
+            if (pos >= size * 8) {
+                overrun = true;
+                return value;
+            }
+            int take = std::min(bits, 8 - (int)(pos & 7));
+            uint8_t byte = data[pos >> 3];
+            uint64_t chunk = (byte >> (8 - (pos & 7) - take)) & ((1u << take) - 1);
+            value = (value << take) | chunk;
+            pos += take;
+            bits -= take;
+        }
+        return value;
+    }
+    
+    uint64_t get_rice(int k) {
+        uint64_t quotient = 0;
+        while (quotient < (uint64_t)RICE_ESCAPE && get(1) == 1 && !overrun) quotient++;
+        if (quotient == (uint64_t)RICE_ESCAPE) return get(64);
+        return (quotient << k) | get(k);
+    }
+    
+    bool overrun = false;
+    
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+};
+
+inline float ordered_to_float(int32_t value) {
+    uint32_t bits = value < 0 ? (0x80000000u | (uint32_t)(-(value + 1))) : (uint32_t)value;
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+inline int64_t lpc_predict(const int32_t* x, int64_t i, int order) {
+    switch (order) {
+        case 0: return 0;
+        case 1: return x[i - 1];
+        case 2: return 2 * (int64_t)x[i - 1] - x[i - 2];
+        case 3: return 3 * (int64_t)x[i - 1] - 3 * (int64_t)x[i - 2] + x[i - 3];
+        default: return 4 * (int64_t)x[i - 1] - 6 * (int64_t)x[i - 2] + 4 * (int64_t)x[i - 3] - x[i - 4];
+    }
+}
+
+inline uint32_t read_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool decode_lpc_channel(const uint8_t* data, size_t size, int64_t total_samples, int block_samples,
+                        std::vector<float>& samples) {
+    samples.resize(total_samples);
+    std::vector<int32_t> x(block_samples);
+    size_t offset = 0;
+    
+    for (int64_t start = 0; start < total_samples; start += block_samples) {
+        int count = (int)std::min<int64_t>(block_samples, total_samples - start);
+        if (offset + 8 > size) return false;
+        
+        uint8_t mode = data[offset], shift = data[offset + 1];
+        int order = data[offset + 2], k = data[offset + 3];
+        uint32_t payload = read_u32(data + offset + 4);
+        offset += 8;
+        if (order > 4 || order > count || offset + order * 4 + payload > size) return false;
+        
+        for (int i = 0; i < order; i++) x[i] = (int32_t)read_u32(data + offset + i * 4);
+        offset += order * 4;
+        
+        BitReader bits(data + offset, payload);
+        for (int i = order; i < count; i++) {
+            uint64_t u = bits.get_rice(k);
+            int64_t residual = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+            x[i] = (int32_t)(lpc_predict(x.data(), i, order) + residual);
+        }
+        if (bits.overrun) return false;
+        offset += payload;
+        
+        float* out = samples.data() + start;
+        if (mode == 0) {
+            for (int i = 0; i < count; i++) out[i] = std::ldexp((float)x[i], -shift);
+        } else {
+            for (int i = 0; i < count; i++) out[i] = ordered_to_float(x[i]);
+        }
+    }
+    return true;
+}
+
+// 📦 BASE64 RGBA - RAW= rows are standard base64 of r,g,b,a bytes
+bool decode_base64_pixels(const char* text, size_t size, std::vector<RGBA>& pixels) {
+    static int8_t values[256];
+    static bool ready = false;
+    if (!ready) {
+        memset(values, -1, sizeof(values));
+        const char* digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; i++) values[(uint8_t)digits[i]] = i;
+        ready = true;
+    }
+    
+    if (size % 4 != 0) return false;
+    std::vector<uint8_t> bytes;
+    bytes.reserve(size / 4 * 3);
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t bits = 0;
+        int pad = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = text[i + k];
+            if (c == '=' && i + 4 == size && k >= 2) {
+                pad++;
+                bits <<= 6;
+                continue;
+            }
+            int8_t value = values[(uint8_t)c];
+            if (value < 0 || pad) return false;
+            bits = bits << 6 | value;
+        }
+        bytes.push_back(bits >> 16);
+        if (pad < 2) bytes.push_back((bits >> 8) & 0xFF);
+        if (pad < 1) bytes.push_back(bits & 0xFF);
+    }
+    
+    if (bytes.size() % 4 != 0) return false;
+    pixels.resize(bytes.size() / 4);
+    memcpy(pixels.data(), bytes.data(), bytes.size());
+    return true;
+}
+
+// Colors con.cpp puts in the palette at most - past that it writes rgba() blocks
+const size_t PALETTE_LIMIT = 1 << 20;
+
+// 📏 V2 ROW LINE - "Y:gap,len,color[,height];..." with palette colors, all 0-based
+bool parse_row_line(const std::string& line, const std::vector<RGBA>& palette,
+                    const std::string& frame_range) {
+    const char* p = line.c_str();
+    char* end;
+    int y = strtol(p, &end, 10);
+    if (*end != ':') return false;
+    p = end + 1;
+    
+    std::vector<SpanRun> row;
+    int next_x = 0;
+    while (*p) {
+        long values[4] = {0, 0, 0, 1};
+        int count = 0;
+        while (count < 4) {
+            values[count++] = strtol(p, &end, 10);
+            if (end == p) return false;
+            p = end;
+            if (*p != ',') break;
+            p++;
+        }
+        if (count < 3 || values[2] < 0 || values[2] >= (long)palette.size()) return false;
+        
+        int x = next_x + (int)values[0];
+        row.push_back({x, y, (int)values[1], (int)values[3], palette[values[2]]});
+        next_x = x + (int)values[1];
+        
+        if (*p == ';') p++;
+        else if (*p) return false;
+    }
+    
+    for (int fn : parse_frame_range(frame_range)) {
+        if (fn > 0 && fn <= (int)frames.size()) {
+            frames[fn - 1].frame_number = fn;
+            frames[fn - 1].runs.insert(frames[fn - 1].runs.end(), row.begin(), row.end());
+        }
+    }
+    return true;
+}
+
 // 📖 PARSE HMICAV FILE
-bool parse_hmicav(const std::string& content) {
+// audio_section: content is a bare HMICA text (its info{} is the audio one)
+bool parse_hmicav(const std::string& content, bool audio_section = false) {
     std::cout << "📖 Parsing HMICAV data...\n";
     
     std::stringstream ss(content);
     std::string line;
     
     enum ParseState { HEADER, VIDEO_INFO, VIDEO_FRAMES, AUDIO_INFO, AUDIO_CHANNELS, NONE };
-    ParseState state = NONE;
+    ParseState state = audio_section ? AUDIO_INFO : NONE;
     
     std::string current_frame_range;
     RGBA current_color;
+    std::vector<RGBA> palette;  // v2 row lines give colors as an index into this
     int current_audio_channel = 0;
+    bool audio_lpc = false;
+    int lpc_block_samples = 4096;
     
     while (std::getline(ss, line)) {
         line.erase(0, line.find_first_not_of(" \t\r\n"));
@@ -242,6 +516,27 @@ bool parse_hmicav(const std::string& content) {
                 video_info.loop = (line.substr(5) == "Y");
                 std::cout << "🔁 Loop: " << (video_info.loop ? "YES" : "NO") << "\n";
             }
+            else if (line.find("VERSION=") == 0) {
+                // v1 (no VERSION= line at all) and v2 are all this player reads
+                std::string version = line.substr(8);
+                if (version != "1" && version != "2") {
+                    std::cerr << "❌ HMIC text v" << version << " not supported (this player reads v1 and v2)\n";
+                    return false;
+                }
+                std::cout << "📜 HMIC text v" << version << "\n";
+            }
+            else if (line.find("PALETTE=") == 0) {
+                // Only a hint - the entries themselves say how many there are
+                long colors = strtol(line.c_str() + 8, nullptr, 10);
+                palette.reserve((size_t)std::clamp(colors, 0L, (long)PALETTE_LIMIT));
+            }
+            else if (line.find("PERIOD=") == 0) {
+                video_info.period = std::stoi(line.substr(7));
+                if (video_info.period > 0 && video_info.period < (int)frames.size()) {
+                    frames.resize(video_info.period);
+                }
+                std::cout << "🔂 Repeats every " << video_info.period << " frames\n";
+            }
         }
         else if (state == VIDEO_FRAMES) {
             if (line[0] == 'F' && line.find('{') != std::string::npos) {
@@ -252,10 +547,62 @@ bool parse_hmicav(const std::string& content) {
                 size_t brace = line.find('{');
                 current_color = parse_rgba(line.substr(0, brace));
             }
-            else if (line.find("P=") == 0 || line.find("PL=") == 0) {
+            else if (isdigit((unsigned char)line[0]) && line.find(':') != std::string::npos) {
+                if (!parse_row_line(line, palette, current_frame_range)) {
+                    std::cerr << "❌ Corrupt row line: " << line.substr(0, 32) << "\n";
+                    return false;
+                }
+            }
+            else if (isdigit((unsigned char)line[0])) {
+                // palette{} entry: N=rgba(r,g,b,a)
+                size_t index;
+                int r, g, b, a;
+                if (sscanf(line.c_str(), "%zu=rgba(%d,%d,%d,%d)", &index, &r, &g, &b, &a) != 5) continue;
+                // Written in order, so every entry is the next index
+                if (index != palette.size() || index >= PALETTE_LIMIT) {
+                    std::cerr << "❌ Palette entry " << index << " out of order\n";
+                    return false;
+                }
+                palette.push_back({(uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)a});
+            }
+            else if (line.find("BG=") == 0) {
+                RGBA background = parse_rgba(line.substr(3));
+                for (int fn : parse_frame_range(current_frame_range)) {
+                    if (fn > 0 && fn <= (int)frames.size()) frames[fn - 1].background = background;
+                }
+            }
+            else if (line.find("RAW=") == 0) {
+                RawRow raw;
+                int y2 = 0;
+                size_t colon = line.find(':');
+                if (colon == std::string::npos ||
+                    sscanf(line.c_str(), "RAW=%dx%d-%dx%d", &raw.x1, &raw.y, &raw.x2, &y2) != 4) continue;
+                raw.x1--; raw.x2--; raw.y--;
+                
+                auto pixels = std::make_shared<std::vector<RGBA>>();
+                if (!decode_base64_pixels(line.c_str() + colon + 1, line.size() - colon - 1, *pixels) ||
+                    (int)pixels->size() != raw.x2 - raw.x1 + 1) {
+                    std::cerr << "❌ Corrupt raw row: " << line.substr(0, colon) << "\n";
+                    return false;
+                }
+                raw.pixels = pixels;
+                
+                for (int fn : parse_frame_range(current_frame_range)) {
+                    if (fn > 0 && fn <= (int)frames.size()) frames[fn - 1].raw_rows.push_back(raw);
+                }
+            }
+            else if (line.find("C=") == 0) {
+                RowCopy copy;
+                if (sscanf(line.c_str(), "C=%dx%d-%dx%d", &copy.x1, &copy.y1, &copy.x2, &copy.y2) != 4) continue;
+                copy.x1--; copy.y1--; copy.x2--; copy.y2--;
+                for (int fn : parse_frame_range(current_frame_range)) {
+                    if (fn > 0 && fn <= (int)frames.size()) frames[fn - 1].copies.push_back(copy);
+                }
+            }
+            else if (line.find("P=") == 0 || line.find("PL=") == 0 || line.find("R=") == 0) {
                 std::vector<int> frame_nums = parse_frame_range(current_frame_range);
                 for (int fn : frame_nums) {
-                    if (fn > 0 && fn <= video_info.total_frames) {
+                    if (fn > 0 && fn <= (int)frames.size()) {
                         frames[fn - 1].frame_number = fn;
                         frames[fn - 1].commands[current_color].push_back(line);
                     }
@@ -277,10 +624,34 @@ bool parse_hmicav(const std::string& content) {
                 audio_data.total_samples = std::stoll(line.substr(4));
                 std::cout << "📊 Audio samples: " << audio_data.total_samples << "\n";
             }
+            else if (line.find("enc=") == 0) {
+                audio_lpc = (line.substr(4) == "LPC");
+                std::cout << "🎼 Audio encoding: " << (audio_lpc ? "lossless LPC" : line.substr(4)) << "\n";
+            }
+            else if (line.find("blk=") == 0) {
+                lpc_block_samples = std::stoi(line.substr(4));
+            }
         }
         else if (state == AUDIO_CHANNELS) {
             if (line[0] == 'C' && line.find('{') != std::string::npos) {
                 current_audio_channel = std::stoi(line.substr(1, line.find('{') - 1)) - 1;
+                
+                if (audio_lpc) {
+                    // Byte count line, then that many raw bytes - read past them in one go
+                    std::string count_line;
+                    std::getline(ss, count_line);
+                    size_t channel_bytes = std::stoull(count_line);
+                    std::vector<uint8_t> payload(channel_bytes);
+                    ss.read((char*)payload.data(), channel_bytes);
+                    
+                    if (current_audio_channel < 0 || current_audio_channel >= audio_data.channels ||
+                        (size_t)ss.gcount() != channel_bytes ||
+                        !decode_lpc_channel(payload.data(), channel_bytes, audio_data.total_samples,
+                                            lpc_block_samples, audio_data.channel_data[current_audio_channel])) {
+                        std::cerr << "❌ Corrupt lossless audio in channel " << (current_audio_channel + 1) << "\n";
+                        return false;
+                    }
+                }
             }
             else if (current_audio_channel >= 0 && current_audio_channel < audio_data.channels) {
                 parse_audio_channel(line, audio_data.channel_data[current_audio_channel]);
@@ -288,6 +659,16 @@ bool parse_hmicav(const std::string& content) {
         }
     }
     
+    // Copies read the row above, so that row has to be final first - top to bottom.
+    // Runs go in memory order so drawing walks the surface front to back.
+    for (Frame& frame : frames) {
+        std::sort(frame.runs.begin(), frame.runs.end(), [](const SpanRun& a, const SpanRun& b) {
+            return a.y != b.y ? a.y < b.y : a.x < b.x;
+        });
+        std::sort(frame.copies.begin(), frame.copies.end(),
+                  [](const RowCopy& a, const RowCopy& b) { return a.y1 < b.y1; });
+    }
+    
     // 🔥 CALCULATE SAMPLES PER FRAME FOR SYNC!!
     if (player_state.has_audio && video_info.total_frames > 0) {
         player_state.samples_per_frame = (double)audio_data.total_samples / video_info.total_frames;
@@ -337,15 +718,537 @@ void draw_line(SDL_Surface* surface, int x1, int y1, int x2, int y2, const RGBA&
     }
 }
 
+// 🟥 DRAW RECT COMMAND - 2-D fill, one SDL_FillRect instead of a line per row
+void draw_rect(SDL_Surface* surface, int x1, int y1, int x2, int y2, const RGBA& color) {
+    SDL_Rect rect = {x1, y1, x2 - x1 + 1, y2 - y1 + 1};
+    SDL_FillRect(surface, &rect, SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a));
+}
+
+// 📋 COPY ROWS COMMAND - each row of the span is a memcpy of the row above
+void copy_rows(SDL_Surface* surface, const RowCopy& copy) {
+    int x1 = std::max(copy.x1, 0);
+    int x2 = std::min(copy.x2, surface->w - 1);
+    if (x1 > x2 || copy.y1 < 1 || copy.y2 >= surface->h) return;
+    
+    Uint32* pixels = (Uint32*)surface->pixels;
+    for (int y = copy.y1; y <= copy.y2; y++) {
+        memcpy(pixels + y * surface->w + x1, pixels + (y - 1) * surface->w + x1,
+               (x2 - x1 + 1) * sizeof(Uint32));
+    }
+}
+
+// ➖ DRAW SPAN - one row run as a straight fill
+void draw_span(SDL_Surface* surface, int x, int y, int len, const RGBA& color) {
+    if (y < 0 || y >= surface->h) return;
+    int x1 = std::max(x, 0);
+    int x2 = std::min(x + len, surface->w);
+    if (x1 >= x2) return;
+    
+    Uint32 pixel_color = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
+    Uint32* row = (Uint32*)surface->pixels + y * surface->w;
+    std::fill(row + x1, row + x2, pixel_color);
+}
+
+// 📦 HMICB - binary command stream (see con.cpp for the layout). The file stays mapped and
+// every frame is drawn straight from the varint records of the blocks its index lists!!
+const char HMICB_MAGIC[8] = {'H', 'M', 'I', 'C', 'B', 0, 0, 0};
+const uint32_t HMICB_VERSION = 3;  // the only layout this player reads
+const uint32_t HMICB_KEYFRAMES = 1;
+const size_t HMICB_HEADER_BYTES = 68;
+
+struct HmicbChunk {
+    uint64_t offset;  // in the file
+    uint64_t start;  // in the uncompressed chunk stream
+    uint32_t stored, raw;
+    uint32_t keyframe;  // keyframe layout: the stored frame the chunk starts with
+};
+
+struct HmicbFile {
+    bool loaded = false;
+    const uint8_t* map = nullptr;
+    size_t map_size = 0;
+    std::vector<HmicbChunk> chunks;
+    std::vector<uint8_t> unpacked;  // only when a chunk was compressed
+    const uint8_t* blocks = nullptr;  // the uncompressed chunk stream
+    size_t blocks_size = 0;
+    std::vector<uint8_t> palette;  // RGBA
+    uint32_t palette_size = 0;
+    std::vector<uint64_t> block_positions;  // record start in the chunk stream, plus the end
+    std::vector<uint32_t> frame_starts;  // per stored frame into frame_blocks, plus the end
+    std::vector<uint32_t> frame_blocks;
+    uint32_t stored_frames = 0;
+    std::vector<Uint32> mapped_palette;  // palette in the surface's pixel format
+    Uint32 mapped_format = 0;
+    
+    // Keyframe layout - block N is frame N painted over frame N - 1, and only the chunk
+    // being played is unpacked, so memory stays at one keyframe interval
+    bool keyframes = false;
+    int current_chunk = -1;
+    std::vector<uint8_t> chunk_data;
+    const uint8_t* chunk_records = nullptr;
+    int shown_frame = -1;  // what shown_surface holds right now
+    SDL_Surface* shown_surface = nullptr;
+    std::vector<Uint32> move_source;  // the frame before, moves read from here
+};
+
+HmicbFile hmicb;
+
+inline uint64_t read_le(const uint8_t* data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)data[i] << (8 * i);
+    return value;
+}
+
+// Signed values are zigzagged - 0, -1, 1, -2, ...
+inline int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+struct VarintReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+    
+    uint64_t next() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) break;
+            uint8_t byte = *p++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        p = end;
+        return 0;
+    }
+    
+    const uint8_t* take(size_t bytes) {
+        if ((size_t)(end - p) < bytes) {
+            ok = false;
+            p = end;
+            return nullptr;
+        }
+        const uint8_t* data = p;
+        p += bytes;
+        return data;
+    }
+};
+
+bool is_hmicb_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[8] = {};
+    return file.read(magic, 8) && memcmp(magic, HMICB_MAGIC, 8) == 0;
+}
+
+// Chunks and the index are zstd frames unless stored size equals raw size
+bool unpack_hmicb(const uint8_t* src, uint32_t stored, uint32_t raw, uint8_t* dst) {
+    if (stored == raw) {
+        memcpy(dst, src, raw);
+        return true;
+    }
+    size_t got = ZSTD_decompress(dst, raw, src, stored);
+    return !ZSTD_isError(got) && got == raw;
+}
+
+bool load_hmicb(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < HMICB_HEADER_BYTES) {
+        if (fd >= 0) close(fd);
+        std::cerr << "❌ Failed to open " << path << "\n";
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "❌ Failed to map " << path << "\n";
+        return false;
+    }
+    hmicb.map = (const uint8_t*)map;
+    hmicb.map_size = st.st_size;
+    
+    const uint8_t* header = hmicb.map + 8;
+    uint32_t fields[11];
+    for (int i = 0; i < 11; i++) fields[i] = read_le(header + 4 * i, 4);
+    uint64_t index_offset = read_le(header + 44, 8);
+    uint32_t index_stored = read_le(header + 52, 4), index_raw = read_le(header + 56, 4);
+    if (fields[0] != HMICB_VERSION) {
+        std::cerr << "❌ HMICB version " << fields[0] << " not supported (this player reads " << HMICB_VERSION
+                  << ") - convert the file again\n";
+        return false;
+    }
+    
+    video_info.width = fields[1];
+    video_info.height = fields[2];
+    video_info.fps = std::max<uint32_t>(fields[3], 1);
+    video_info.total_frames = fields[4];
+    video_info.period = fields[5];
+    video_info.loop = true;
+    player_state.frame_duration_ms = 1000.0 / video_info.fps;
+    hmicb.palette_size = fields[6];
+    uint32_t chunk_count = fields[7];
+    uint32_t block_count = fields[8];
+    hmicb.stored_frames = fields[9];
+    hmicb.keyframes = (fields[10] & HMICB_KEYFRAMES) != 0;
+    
+    std::vector<uint8_t> index(index_raw);
+    if (index_offset < HMICB_HEADER_BYTES || index_offset + index_stored > hmicb.map_size ||
+        !unpack_hmicb(hmicb.map + index_offset, index_stored, index_raw, index.data())) {
+        std::cerr << "❌ Corrupt HMICB index\n";
+        return false;
+    }
+    
+    // Chunks sit back to back after the header, the index says how big each one is
+    VarintReader reader{index.data(), index.data() + index.size()};
+    uint64_t offset = HMICB_HEADER_BYTES, raw_total = 0;
+    for (uint32_t i = 0; i < chunk_count && reader.ok; i++) {
+        uint32_t stored = (uint32_t)reader.next(), raw = (uint32_t)reader.next();
+        hmicb.chunks.push_back({offset, raw_total, stored, raw, 0});
+        offset += stored;
+        raw_total += raw;
+    }
+    const uint8_t* palette = reader.take(4ull * hmicb.palette_size);
+    if (palette) hmicb.palette.assign(palette, palette + 4ull * hmicb.palette_size);
+    
+    hmicb.block_positions.assign(1, 0);
+    for (uint32_t i = 0; i < block_count && reader.ok; i++) {
+        hmicb.block_positions.push_back(hmicb.block_positions.back() + reader.next());
+    }
+    
+    bool valid = reader.ok && offset <= index_offset && hmicb.block_positions.back() <= raw_total;
+    if (hmicb.keyframes) {
+        // Every chunk has to start right at its keyframe's record, the first one at frame 0
+        valid = valid && block_count == hmicb.stored_frames && chunk_count > 0 &&
+                hmicb.block_positions.back() == raw_total;
+        uint64_t keyframe = 0;
+        for (uint32_t i = 0; i < chunk_count && valid; i++) {
+            uint64_t step = reader.next();
+            keyframe += step;
+            valid = reader.ok && (i == 0 ? step == 0 : step > 0) && keyframe < hmicb.stored_frames &&
+                    hmicb.block_positions[keyframe] == hmicb.chunks[i].start;
+            hmicb.chunks[i].keyframe = (uint32_t)keyframe;
+        }
+    } else {
+        hmicb.frame_starts.assign(1, 0);
+        for (uint32_t frame = 0; frame < hmicb.stored_frames && reader.ok; frame++) {
+            uint64_t n_blocks = reader.next();
+            uint32_t block_id = 0;
+            for (uint64_t i = 0; i < n_blocks && reader.ok; i++) {
+                block_id += (uint32_t)reader.next();
+                hmicb.frame_blocks.push_back(block_id);
+            }
+            hmicb.frame_starts.push_back((uint32_t)hmicb.frame_blocks.size());
+        }
+        valid = valid && reader.ok;
+    }
+    if (!valid) {
+        std::cerr << "❌ Corrupt HMICB index\n";
+        return false;
+    }
+    
+    // Stored chunks are used right out of the mapping, compressed ones get unpacked once -
+    // keyframe files get theirs one at a time from load_hmicb_chunk() instead
+    bool all_stored = true;
+    for (const auto& chunk : hmicb.chunks) all_stored = all_stored && chunk.stored == chunk.raw;
+    
+    if (hmicb.keyframes) {
+        hmicb.blocks = nullptr;
+    } else if (all_stored) {
+        hmicb.blocks = hmicb.map + HMICB_HEADER_BYTES;
+    } else {
+        std::cout << "🌀 Unpacking HMICB chunks...\n";
+        hmicb.unpacked.resize(raw_total);
+        for (size_t i = 0; i < hmicb.chunks.size(); i++) {
+            const HmicbChunk& chunk = hmicb.chunks[i];
+            if (!unpack_hmicb(hmicb.map + chunk.offset, chunk.stored, chunk.raw, hmicb.unpacked.data() + chunk.start)) {
+                std::cerr << "❌ Corrupt HMICB chunk " << i << "\n";
+                return false;
+            }
+        }
+        hmicb.blocks = hmicb.unpacked.data();
+    }
+    hmicb.blocks_size = raw_total;
+    
+    hmicb.loaded = true;
+    std::cout << "📦 HMICB: " << video_info.width << "x" << video_info.height << " @ " << video_info.fps
+              << " FPS, " << video_info.total_frames << " frames, " << block_count << " blocks, "
+              << hmicb.palette_size << " colors";
+    if (hmicb.keyframes) std::cout << ", " << chunk_count << " keyframes";
+    std::cout << "\n";
+    return true;
+}
+
+// 🎵 HMICB AUDIO - the .hmicb holds only the picture, the converter writes the sound next to
+// it as <stem>.hmica7 (a zstd HMICA). No such file = a silent clip.
+bool load_hmicb_audio(const std::string& path) {
+    std::string audio_path = std::filesystem::path(path).replace_extension(".hmica7").string();
+    std::ifstream file(audio_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return true;
+    
+    std::vector<char> buffer(file.tellg());
+    file.seekg(0, std::ios::beg);
+    if (!file.read(buffer.data(), buffer.size())) {
+        std::cerr << "❌ Failed to read " << audio_path << "\n";
+        return false;
+    }
+    
+    std::cout << "🎵 Audio from " << audio_path << "\n";
+    std::string content = decompress_zstd(buffer.data(), buffer.size());
+    if (content.empty()) {
+        std::cerr << "❌ Decompression failed\n";
+        return false;
+    }
+    if (!parse_hmicav(content, true)) {
+        std::cerr << "❌ Failed to parse " << audio_path << "\n";
+        return false;
+    }
+    return true;
+}
+
+Uint32 read_hmicb_color(VarintReader& reader, const SDL_PixelFormat* format) {
+    uint64_t index = reader.next();
+    if (index == 0) {
+        const uint8_t* c = reader.take(4);
+        return c ? SDL_MapRGBA(format, c[0], c[1], c[2], c[3]) : 0;
+    }
+    if (index > hmicb.mapped_palette.size()) {
+        reader.ok = false;
+        return 0;
+    }
+    return hmicb.mapped_palette[index - 1];
+}
+
+void skip_hmicb_spans(VarintReader& reader) {
+    uint64_t spans = reader.next();
+    for (uint64_t i = 0; i < spans && reader.ok; i++) {
+        reader.next();
+        reader.next();
+    }
+}
+
+// Runs, raw rows and copies of one record, read past its spans and background. Copies only
+// get collected - they read the row above, so they run after everything else is drawn.
+void draw_hmicb_record(SDL_Surface* surface, VarintReader& reader, std::vector<RowCopy>& copies) {
+    Uint32* pixels = (Uint32*)surface->pixels;
+    uint64_t rows = reader.next();
+    int y = 0;
+    for (uint64_t row = 0; row < rows && reader.ok; row++) {
+        y += (int)reader.next();
+        uint64_t runs = reader.next();
+        int x = 0;
+        for (uint64_t run = 0; run < runs && reader.ok; run++) {
+            x += (int)reader.next();
+            int len = (int)reader.next() + 1;
+            Uint32 color = read_hmicb_color(reader, surface->format);
+            int height = (int)reader.next() + 1;
+            if (!reader.ok) break;
+            
+            int x1 = std::max(x, 0), x2 = std::min(x + len, surface->w);
+            int y2 = std::min(y + height, surface->h);
+            for (int yy = std::max(y, 0); yy < y2 && x1 < x2; yy++) {
+                std::fill(pixels + yy * surface->w + x1, pixels + yy * surface->w + x2, color);
+            }
+            x += len;
+        }
+    }
+    
+    uint64_t raws = reader.next();
+    for (uint64_t i = 0; i < raws && reader.ok; i++) {
+        int ry = (int)reader.next();
+        int rx = (int)reader.next();
+        int len = (int)reader.next() + 1;
+        const uint8_t* c = reader.take(4ull * len);
+        if (!c) break;
+        for (int k = 0; k < len; k++) {
+            draw_pixel(surface, rx + k, ry, {c[4 * k], c[4 * k + 1], c[4 * k + 2], c[4 * k + 3]});
+        }
+    }
+    
+    uint64_t n_copies = reader.next();
+    for (uint64_t i = 0; i < n_copies && reader.ok; i++) {
+        RowCopy copy;
+        copy.x1 = (int)reader.next();
+        copy.y1 = (int)reader.next();
+        copy.x2 = copy.x1 + (int)reader.next();
+        copy.y2 = copy.y1 + (int)reader.next();
+        if (reader.ok) copies.push_back(copy);
+    }
+}
+
+// 🏃 Moves - rects of the frame before at an offset (scrolling!!), one memcpy per row. They
+// all read the frame as it was, so the surface is copied aside first.
+void apply_hmicb_moves(SDL_Surface* surface, VarintReader& reader) {
+    uint64_t n_moves = reader.next();
+    if (n_moves == 0 || !reader.ok) return;
+    
+    Uint32* pixels = (Uint32*)surface->pixels;
+    hmicb.move_source.assign(pixels, pixels + (size_t)surface->w * surface->h);
+    for (uint64_t i = 0; i < n_moves && reader.ok; i++) {
+        uint64_t x = reader.next();
+        uint64_t y = reader.next();
+        uint64_t len = reader.next() + 1;
+        uint64_t height = reader.next() + 1;
+        int64_t dx = unzigzag(reader.next());
+        int64_t dy = unzigzag(reader.next());
+        if (!reader.ok) break;
+        if (x >= (uint64_t)surface->w || y >= (uint64_t)surface->h || len > (uint64_t)surface->w ||
+            height > (uint64_t)surface->h || dx <= -surface->w || dx >= surface->w || dy <= -surface->h ||
+            dy >= surface->h) {
+            continue;
+        }
+        
+        // Clip both the destination and the source to the surface
+        int x1 = std::max((int)x, (int)-dx);
+        int x2 = std::min((int)(x + len), surface->w - (int)std::max(dx, (int64_t)0));
+        int y1 = std::max((int)y, (int)-dy);
+        int y2 = std::min((int)(y + height), surface->h - (int)std::max(dy, (int64_t)0));
+        for (int yy = y1; yy < y2 && x1 < x2; yy++) {
+            memcpy(pixels + yy * surface->w + x1, hmicb.move_source.data() + (yy + dy) * surface->w + (x1 + dx),
+                   (x2 - x1) * sizeof(Uint32));
+        }
+    }
+}
+
+// Copies read the row above - top to bottom, after everything else
+void apply_row_copies(SDL_Surface* surface, std::vector<RowCopy>& copies) {
+    std::sort(copies.begin(), copies.end(), [](const RowCopy& a, const RowCopy& b) { return a.y1 < b.y1; });
+    for (const RowCopy& copy : copies) copy_rows(surface, copy);
+    copies.clear();
+}
+
+bool load_hmicb_chunk(int chunk_idx) {
+    if (hmicb.current_chunk == chunk_idx) return true;
+    
+    const HmicbChunk& chunk = hmicb.chunks[chunk_idx];
+    hmicb.current_chunk = -1;
+    if (chunk.stored == chunk.raw) {
+        hmicb.chunk_records = hmicb.map + chunk.offset;
+    } else {
+        hmicb.chunk_data.resize(chunk.raw);
+        if (!unpack_hmicb(hmicb.map + chunk.offset, chunk.stored, chunk.raw, hmicb.chunk_data.data())) {
+            std::cerr << "❌ Corrupt HMICB chunk " << chunk_idx << "\n";
+            return false;
+        }
+        hmicb.chunk_records = hmicb.chunk_data.data();
+    }
+    hmicb.current_chunk = chunk_idx;
+    return true;
+}
+
+// 🔑 Keyframe layout - the surface still holds hmicb.shown_frame, so playing on is one delta.
+// Anything else (a seek, looping back) starts over from the keyframe at or before the frame.
+void render_hmicb_keyframes(SDL_Surface* surface, int frame_idx) {
+    if (surface != hmicb.shown_surface) hmicb.shown_frame = -1;
+    if (frame_idx == hmicb.shown_frame) return;
+    
+    auto next_chunk = std::upper_bound(hmicb.chunks.begin(), hmicb.chunks.end(), (uint32_t)frame_idx,
+                                       [](uint32_t frame, const HmicbChunk& chunk) { return frame < chunk.keyframe; });
+    int chunk_idx = (int)(next_chunk - hmicb.chunks.begin()) - 1;
+    const HmicbChunk& chunk = hmicb.chunks[chunk_idx];
+    int first = (int)chunk.keyframe;
+    if (hmicb.shown_frame >= first && hmicb.shown_frame < frame_idx) first = hmicb.shown_frame + 1;
+    
+    hmicb.shown_frame = -1;
+    if (!load_hmicb_chunk(chunk_idx)) {
+        SDL_FillRect(surface, nullptr, SDL_MapRGB(surface->format, 0, 0, 0));
+        return;
+    }
+    
+    std::vector<RowCopy> copies;
+    for (int frame = first; frame <= frame_idx; frame++) {
+        VarintReader reader{hmicb.chunk_records + (hmicb.block_positions[frame] - chunk.start),
+                            hmicb.chunk_records + (hmicb.block_positions[frame + 1] - chunk.start)};
+        skip_hmicb_spans(reader);
+        if (frame == (int)chunk.keyframe) SDL_FillRect(surface, nullptr, SDL_MapRGB(surface->format, 0, 0, 0));
+        if (reader.next()) {
+            Uint32 color = read_hmicb_color(reader, surface->format);
+            if (reader.ok) SDL_FillRect(surface, nullptr, color);
+        }
+        apply_hmicb_moves(surface, reader);
+        draw_hmicb_record(surface, reader, copies);
+        apply_row_copies(surface, copies);
+    }
+    
+    hmicb.shown_frame = frame_idx;
+    hmicb.shown_surface = surface;
+}
+
+void render_hmicb_frame(SDL_Surface* surface, int frame_idx) {
+    if (video_info.period > 0) frame_idx %= video_info.period;
+    if (frame_idx < 0 || frame_idx >= (int)hmicb.stored_frames) {
+        SDL_FillRect(surface, nullptr, SDL_MapRGB(surface->format, 0, 0, 0));
+        hmicb.shown_frame = -1;
+        return;
+    }
+    
+    if (hmicb.mapped_format != surface->format->format || hmicb.mapped_palette.size() != hmicb.palette_size) {
+        hmicb.mapped_palette.resize(hmicb.palette_size);
+        for (uint32_t i = 0; i < hmicb.palette_size; i++) {
+            const uint8_t* c = hmicb.palette.data() + 4 * i;
+            hmicb.mapped_palette[i] = SDL_MapRGBA(surface->format, c[0], c[1], c[2], c[3]);
+        }
+        hmicb.mapped_format = surface->format->format;
+        hmicb.shown_frame = -1;
+    }
+    
+    if (hmicb.keyframes) {
+        render_hmicb_keyframes(surface, frame_idx);
+        return;
+    }
+    
+    uint32_t first = hmicb.frame_starts[frame_idx];
+    uint32_t last = hmicb.frame_starts[frame_idx + 1];
+    
+    auto block_reader = [&](uint32_t entry) {
+        uint32_t block_id = hmicb.frame_blocks[entry];
+        if (block_id + 1 >= hmicb.block_positions.size()) return VarintReader{nullptr, nullptr, false};
+        return VarintReader{hmicb.blocks + hmicb.block_positions[block_id],
+                            hmicb.blocks + hmicb.block_positions[block_id + 1]};
+    };
+    
+    // Background first - its block can come anywhere in the list
+    SDL_FillRect(surface, nullptr, SDL_MapRGB(surface->format, 0, 0, 0));
+    for (uint32_t entry = first; entry < last; entry++) {
+        VarintReader reader = block_reader(entry);
+        if (!reader.ok) continue;
+        skip_hmicb_spans(reader);
+        if (reader.next()) {
+            Uint32 color = read_hmicb_color(reader, surface->format);
+            if (reader.ok) SDL_FillRect(surface, nullptr, color);
+        }
+    }
+    
+    std::vector<RowCopy> copies;
+    for (uint32_t entry = first; entry < last; entry++) {
+        VarintReader reader = block_reader(entry);
+        if (!reader.ok) continue;
+        skip_hmicb_spans(reader);
+        if (reader.next()) read_hmicb_color(reader, surface->format);
+        draw_hmicb_record(surface, reader, copies);
+    }
+    apply_row_copies(surface, copies);
+}
+
 // 🎨 RENDER FRAME
 void render_frame(SDL_Surface* surface, int frame_idx) {
-    if (frame_idx < 0 || frame_idx >= frames.size()) return;
+    if (hmicb.loaded) {
+        render_hmicb_frame(surface, frame_idx);
+        return;
+    }
+    
+    if (video_info.period > 0) frame_idx %= video_info.period;
+    if (frame_idx < 0 || frame_idx >= frames.size()) {
+        SDL_FillRect(surface, nullptr, SDL_MapRGB(surface->format, 0, 0, 0));
+        return;
+    }
     
     const Frame& frame = frames[frame_idx];
     
+    // Background first - the encoder left out every run of this color
+    const RGBA& bg = frame.background;
+    SDL_FillRect(surface, nullptr, SDL_MapRGBA(surface->format, bg.r, bg.g, bg.b, bg.a));
+    
     for (const auto& [color, commands] : frame.commands) {
         for (const std::string& cmd : commands) {
-            if (cmd.find("PL=") == 0) {
+            if (cmd.find("PL=") == 0 || cmd.find("R=") == 0) {
                 size_t eq = cmd.find('=');
                 size_t dash = cmd.find('-', eq);
                 
@@ -360,7 +1263,8 @@ void render_frame(SDL_Surface* surface, int frame_idx) {
                 int x2 = std::stoi(end_str.substr(0, x_pos2)) - 1;
                 int y2 = std::stoi(end_str.substr(x_pos2 + 1)) - 1;
                 
-                draw_line(surface, x1, y1, x2, y2, color);
+                if (cmd[0] == 'R') draw_rect(surface, x1, y1, x2, y2, color);
+                else draw_line(surface, x1, y1, x2, y2, color);
             }
             else if (cmd.find("P=") == 0) {
                 size_t eq = cmd.find('=');
@@ -374,6 +1278,17 @@ void render_frame(SDL_Surface* surface, int frame_idx) {
             }
         }
     }
+    
+    for (const SpanRun& run : frame.runs) {
+        if (run.height > 1) draw_rect(surface, run.x, run.y, run.x + run.len - 1, run.y + run.height - 1, run.color);
+        else draw_span(surface, run.x, run.y, run.len, run.color);
+    }
+    
+    for (const RawRow& raw : frame.raw_rows) {
+        for (int x = raw.x1; x <= raw.x2; x++) draw_pixel(surface, x, raw.y, (*raw.pixels)[x - raw.x1]);
+    }
+    
+    for (const RowCopy& copy : frame.copies) copy_rows(surface, copy);
 }
 
 // 🎵 AUDIO CALLBACK - FIXED FOR SYNC!!
@@ -428,47 +1343,73 @@ int main(int argc, char* argv[]) {
     if (argc > 1) {
         file_path = argv[1];
     } else {
-        std::cout << "Enter HMICAV file path (.hmicav or .hmicav7): ";
+        std::cout << "Enter HMICAV file path (.hmicav, .hmicav7 or .hmicb): ";
         std::getline(std::cin, file_path);
     }
     
-    // 📂 LOAD FILE
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        std::cerr << "❌ Failed to open file\n";
-        return 1;
-    }
-    
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    // 📦 HMICB is mapped and drawn from directly - nothing to read or parse up front but its audio
+    bool binary_file = is_hmicb_file(file_path);
+    if (binary_file && (!load_hmicb(file_path) || !load_hmicb_audio(file_path))) return 1;
     
-    std::vector<char> buffer(size);
-    if (!file.read(buffer.data(), size)) {
-        std::cerr << "❌ Failed to read file\n";
-        return 1;
-    }
-    file.close();
-    
-    std::cout << "📂 File loaded: " << (size / 1024.0) << " KB\n";
-    
-    // 🔓 DECOMPRESS IF NEEDED
-    std::string content;
-    if (file_path.find(".hmicav7") != std::string::npos) {
-        std::cout << "🌀 Decompressing Zstd...\n";
-        content = decompress_zstd(buffer);
-        if (content.empty()) {
-            std::cerr << "❌ Decompression failed\n";
+    if (!binary_file) {
+        // 📂 LOAD FILE
+        std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            std::cerr << "❌ Failed to open file\n";
             return 1;
         }
-        std::cout << "✅ Decompressed to " << (content.size() / 1024.0) << " KB\n";
-    } else {
-        content = std::string(buffer.begin(), buffer.end());
-    }
-    
-    // 📖 PARSE CONTENT
-    if (!parse_hmicav(content)) {
-        std::cerr << "❌ Failed to parse HMICAV\n";
-        return 1;
+        
+        std::streamsize size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        
+        std::vector<char> buffer(size);
+        if (!file.read(buffer.data(), size)) {
+            std::cerr << "❌ Failed to read file\n";
+            return 1;
+        }
+        file.close();
+        
+        std::cout << "📂 File loaded: " << (size / 1024.0) << " KB\n";
+        
+        // 🔓 DECOMPRESS IF NEEDED
+        std::string content, audio_content;
+        HmicavSections sections;
+        if (parse_section_header(buffer, sections)) {
+            // Video and audio were compressed separately - unpack both at the same time!!
+            std::cout << "🌀 Decompressing Zstd sections in parallel...\n";
+            std::thread audio_thread;
+            if (sections.has_audio) {
+                audio_thread = std::thread([&]() {
+                    audio_content = decompress_zstd(buffer.data() + sections.audio_offset, sections.audio_size);
+                });
+            }
+            content = decompress_zstd(buffer.data() + sections.video_offset, sections.video_size);
+            if (audio_thread.joinable()) audio_thread.join();
+        
+            if (content.empty() || (sections.has_audio && audio_content.empty())) {
+                std::cerr << "❌ Decompression failed\n";
+                return 1;
+            }
+            std::cout << "✅ Decompressed to " << ((content.size() + audio_content.size()) / 1024.0) << " KB\n";
+        } else if (file_path.find(".hmicav7") != std::string::npos) {
+            std::cout << "🌀 Decompressing Zstd...\n";
+            content = decompress_zstd(buffer.data(), buffer.size());
+            if (content.empty()) {
+                std::cerr << "❌ Decompression failed\n";
+                return 1;
+            }
+            std::cout << "✅ Decompressed to " << (content.size() / 1024.0) << " KB\n";
+        } else {
+            content = std::string(buffer.begin(), buffer.end());
+        }
+        std::vector<char>().swap(buffer);
+        
+        // 📖 PARSE CONTENT
+        if (!parse_hmicav(content) || (!audio_content.empty() && !parse_hmicav(audio_content, true))) {
+            std::cerr << "❌ Failed to parse HMICAV\n";
+            return 1;
+        }
+        
     }
     
     // 🎮 INITIALIZE SDL
@@ -631,10 +1572,7 @@ int main(int argc, char* argv[]) {
         ).count();
         
         if (since_render >= 16) {  // ~60 FPS render cap
-            // Clear screen
-            SDL_FillRect(screen_surface, nullptr, SDL_MapRGB(screen_surface->format, 0, 0, 0));
-            
-            // Render current frame
+            // Render current frame (clears to its background)
             render_frame(screen_surface, player_state.current_frame);
             
             // Update window